@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "arg_parser.h"
+#include "mapped_file.h"
+#include "rom_database.h"
+
+// Translates a ROM to a C++ translation unit, ahead of time. The ROM's
+// control-flow graph is recovered from ROM_START by following jumps, calls,
+// skips and the return sites of calls, and every basic block in it becomes a
+// function. Building the output into the emulator registers it for that ROM
+// under the mode and quirks it was made with, for --cpu=aot.
+//
+// Simple instructions are written out as C++, with the quirks resolved;
+// the rest call the interpreter's handlers. Whatever the graph does not
+// reach, such as Bnnn targets, is left to the interpreter at run time.
+
+static constexpr size_t MAX_BLOCK_LENGTH = 64;
+
+// How an instruction passes control on.
+enum class Flow {
+    NEXT,
+    JUMP,
+    CALL,
+    RETURN,
+    SKIP,
+    // Fx0A repeats itself until a key is pressed.
+    WAIT,
+    // Fx33 and Fx55 may rewrite the code after them, so a block ends there
+    // and the next one is checked before it runs.
+    STORE,
+    INDIRECT,
+};
+
+static bool is(const char* name, const char* handler) {
+    return std::strcmp(name, handler) == 0;
+}
+
+static Flow flowOf(const char* name) {
+    if (is(name, "1nnn")) return Flow::JUMP;
+    if (is(name, "2nnn")) return Flow::CALL;
+    if (is(name, "00EE")) return Flow::RETURN;
+    if (is(name, "Bnnn")) return Flow::INDIRECT;
+    if (is(name, "Fx0A")) return Flow::WAIT;
+    if (is(name, "Fx33") || is(name, "Fx55")) return Flow::STORE;
+    if (is(name, "3xkk") || is(name, "4xkk") || is(name, "5xy0") || is(name, "9xy0")
+        || is(name, "Ex9E") || is(name, "ExA1")) {
+        return Flow::SKIP;
+    }
+
+    return Flow::NEXT;
+}
+
+class Translator {
+
+    public:
+        Translator(std::span<const uint8_t> rom, const Settings& settings)
+            : rom(rom), settings(settings), reachable(memorySize(Mode::CHIP_8)), leader(reachable.size()) {}
+
+        void recoverGraph();
+        std::string emit(const std::string& name, uint64_t fingerprint) const;
+        size_t blockCount() const;
+        size_t instructionCount() const;
+
+    private:
+        std::span<const uint8_t> rom;
+        Settings settings;
+        std::vector<bool> reachable;
+        std::vector<bool> leader;
+
+        bool inRom(size_t addr) const;
+        uint16_t opAt(size_t addr) const;
+        std::string emitInstruction(uint16_t addr, std::string& pc) const;
+};
+
+// Only the ROM image is translated: the fonts are data, and memory past the
+// ROM starts out as zeroes.
+bool Translator::inRom(size_t addr) const {
+    return addr >= ROM_START && addr + 2 <= ROM_START + rom.size();
+}
+
+uint16_t Translator::opAt(size_t addr) const {
+    return uint16_t(rom[addr - ROM_START] << 8 | rom[addr + 1 - ROM_START]);
+}
+
+void Translator::recoverGraph() {
+    std::vector<size_t> work = { ROM_START };
+    leader[ROM_START] = true;
+
+    auto branch = [&](size_t addr) {
+        if (addr < leader.size()) {
+            leader[addr] = true;
+            work.push_back(addr);
+        }
+    };
+
+    while (!work.empty()) {
+        const size_t addr = work.back();
+        work.pop_back();
+
+        if (!inRom(addr) || reachable[addr]) {
+            continue;
+        }
+
+        reachable[addr] = true;
+
+        const Decoded d = decode(opAt(addr));
+
+        switch (flowOf(Chip8::opcodeName(d.raw))) {
+            case Flow::NEXT:
+                work.push_back(addr + 2);
+                break;
+
+            case Flow::JUMP:
+                branch(d.nnn);
+                break;
+
+            // Returns come back to the instruction after each call.
+            case Flow::CALL:
+                branch(d.nnn);
+                branch(addr + 2);
+                break;
+
+            case Flow::SKIP:
+                branch(addr + 2);
+                branch(addr + 4);
+                break;
+
+            case Flow::WAIT:
+                branch(addr);
+                branch(addr + 2);
+                break;
+
+            case Flow::STORE:
+                branch(addr + 2);
+                break;
+
+            case Flow::RETURN:
+            case Flow::INDIRECT:
+                break;
+        }
+    }
+}
+
+size_t Translator::blockCount() const {
+    size_t count = 0;
+    for (size_t addr = 0; addr < leader.size(); ++addr) {
+        count += leader[addr] && reachable[addr];
+    }
+
+    return count;
+}
+
+size_t Translator::instructionCount() const {
+    return size_t(std::count(reachable.begin(), reachable.end(), true));
+}
+
+static std::string format(const char* fmt, auto... args) {
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), fmt, args...);
+    return buf;
+}
+
+static std::string literal(const Decoded& d) {
+    return format("{0x%04X, 0x%03X, 0x%02X, 0x%X, 0x%X, 0x%X}", d.raw, d.nnn, d.nn, d.n, d.x, d.y);
+}
+
+// Returns the C++ for one instruction. pc is set to the expression for the
+// next PC when the instruction ends the block, and left empty otherwise.
+std::string Translator::emitInstruction(uint16_t addr, std::string& pc) const {
+    const Decoded d = decode(opAt(addr));
+    const char* name = Chip8::opcodeName(d.raw);
+    const Quirks& q = settings.quirks;
+    const std::string call = format("(%s);\n", literal(d).c_str());
+    const std::string next = format("0x%03X", addr + 2);
+    const std::string skip = format("0x%03X : 0x%03X", addr + 4, addr + 2);
+
+    std::string out = format("        // %03X: %04X\n", addr, d.raw);
+    auto line = [&out](const std::string& s) {
+        out += "        " + s + "\n";
+    };
+
+    pc.clear();
+
+    // XO-CHIP's opcodes are unhandled in the modes that can be translated.
+    if (is(name, "6xkk")) {
+        line(format("V[0x%X] = 0x%02X;", d.x, d.nn));
+    } else if (is(name, "7xkk")) {
+        line(format("V[0x%X] = uint8_t(V[0x%X] + 0x%02X);", d.x, d.x, d.nn));
+    } else if (is(name, "8xy0")) {
+        line(format("V[0x%X] = V[0x%X];", d.x, d.y));
+    } else if (is(name, "8xy1") || is(name, "8xy2") || is(name, "8xy3")) {
+        const char op = is(name, "8xy1") ? '|' : is(name, "8xy2") ? '&' : '^';
+        line(format("V[0x%X] = V[0x%X] %c V[0x%X];", d.x, d.x, op, d.y));
+        if (q.vfReset) {
+            line("V[0xF] = 0;");
+        }
+    } else if (is(name, "8xy4")) {
+        line(format("{ const unsigned r = V[0x%X] + V[0x%X]; V[0x%X] = uint8_t(r); V[0xF] = r > 0xFF; }", d.x, d.y, d.x));
+    } else if (is(name, "8xy5") || is(name, "8xy7")) {
+        const bool reverse = is(name, "8xy7");
+        line(format("{ const uint8_t x = V[0x%X], y = V[0x%X]; V[0x%X] = uint8_t(%s); V[0xF] = %s; }",
+                    d.x, d.y, d.x, reverse ? "y - x" : "x - y", reverse ? "y >= x" : "x >= y"));
+    } else if (is(name, "8xy6") || is(name, "8xyE")) {
+        const bool left = is(name, "8xyE");
+        if (!q.shift) {
+            line(format("V[0x%X] = V[0x%X];", d.x, d.y));
+        }
+        line(format("{ const uint8_t bit = %s; V[0x%X] %s= 1; V[0xF] = bit; }",
+                    format(left ? "V[0x%X] >> 7" : "V[0x%X] & 1", d.x).c_str(), d.x, left ? "<<" : ">>"));
+    } else if (is(name, "Annn")) {
+        line(format("c.I = 0x%03X;", d.nnn));
+    } else if (is(name, "Fx1E")) {
+        line(format("c.I = uint16_t(c.I + V[0x%X]);", d.x));
+    } else if (is(name, "Fx07")) {
+        line(format("V[0x%X] = c.delayTimer;", d.x));
+    } else if (is(name, "Fx15")) {
+        line(format("c.delayTimer = V[0x%X];", d.x));
+    } else if (is(name, "Fx18")) {
+        line(format("c.soundTimer = V[0x%X];", d.x));
+    } else if (is(name, "Fx29")) {
+        line(format("c.I = uint16_t(FONT_START + V[0x%X] * 5);", d.x));
+    } else if (is(name, "Fx30")) {
+        line(format("c.I = uint16_t(BIGFONT_START + (V[0x%X] & 0x0F) * 10);", d.x));
+    } else if (is(name, "1nnn")) {
+        pc = format("0x%03X", d.nnn);
+    } else if (is(name, "3xkk") || is(name, "4xkk")) {
+        pc = format("V[0x%X] %s 0x%02X ? %s", d.x, is(name, "3xkk") ? "==" : "!=", d.nn, skip.c_str());
+    } else if (is(name, "5xy0") || is(name, "9xy0")) {
+        pc = format("V[0x%X] %s V[0x%X] ? %s", d.x, is(name, "5xy0") ? "==" : "!=", d.y, skip.c_str());
+    } else if (flowOf(name) != Flow::NEXT) {
+        // The handler moves PC on from the next instruction itself.
+        line("c.PC = " + next + ";");
+
+        if (is(name, "Bnnn")) {
+            out += format("        c.op_Bnnn<%s>", q.jump ? "true" : "false") + call;
+        } else if (is(name, "Ex9E") || is(name, "ExA1")) {
+            out += format("        c.op_%s<false>", name) + call;
+        } else if (is(name, "Fx0A")) {
+            out += format("        c.op_Fx0A<%s>", q.press ? "true" : "false") + call;
+        } else if (is(name, "Fx55")) {
+            out += format("        c.op_Fx55<%s>", q.memory ? "true" : "false") + call;
+        } else {
+            out += format("        c.op_%s", name) + call;
+        }
+
+        return out;
+    } else if (is(name, "Dxyn")) {
+        out += format("        c.op_Dxyn<%s, false>", q.clipping ? "true" : "false") + call;
+    } else if (is(name, "Fx65")) {
+        out += format("        c.op_Fx65<%s>", q.memory ? "true" : "false") + call;
+    } else if (is(name, "00DN") || is(name, "5xy2") || is(name, "5xy3") || is(name, "F000")
+               || is(name, "Fn01") || is(name, "F002") || is(name, "Fx3A")) {
+        out += "        c.op_unhandled" + call;
+    } else {
+        out += format("        c.op_%s", name) + call;
+    }
+
+    if (!pc.empty()) {
+        line("c.PC = " + pc + ";");
+    }
+
+    return out;
+}
+
+std::string Translator::emit(const std::string& name, uint64_t fingerprint) const {
+    std::string out;
+    std::string blocks;
+
+    out += "// Generated by chip8-aot from " + name + ". Do not edit.\n\n";
+    out += "#include \"chip8.h\"\n\n";
+    out += "namespace {\n\nstruct Program;\n\n}\n\n";
+    out += "template <>\nstruct AotBlocks<Program> {\n";
+
+    bool first = true;
+    for (size_t start = 0; start < leader.size(); ++start) {
+        if (!leader[start] || !reachable[start]) {
+            continue;
+        }
+
+        if (!first) {
+            out += "\n";
+        }
+        first = false;
+
+        out += format("    static void block_%03X(Chip8& c) noexcept {\n", unsigned(start));
+        out += "        [[maybe_unused]] auto& V = c.V;\n\n";
+
+        size_t addr = start;
+        size_t length = 0;
+        std::string pc;
+
+        while (true) {
+            out += emitInstruction(uint16_t(addr), pc);
+            length++;
+
+            if (!pc.empty() || flowOf(Chip8::opcodeName(opAt(addr))) != Flow::NEXT) {
+                break;
+            }
+
+            addr += 2;
+
+            if (addr >= reachable.size() || !reachable[addr] || leader[addr] || length == MAX_BLOCK_LENGTH) {
+                out += format("        c.PC = 0x%03X;\n", unsigned(addr));
+                break;
+            }
+        }
+
+        out += "    }\n";
+        blocks += format("    { 0x%03X, %u, &AotBlocks<Program>::block_%03X },\n", unsigned(start), unsigned(length), unsigned(start));
+    }
+
+    out += "};\n\nnamespace {\n\n";
+
+    out += "constexpr uint8_t ROM[] = {";
+    for (size_t i = 0; i < rom.size(); ++i) {
+        out += (i % 16 == 0 ? "\n    " : " ") + format("0x%02X,", rom[i]);
+    }
+    out += "\n};\n\n";
+
+    out += "constexpr AotBlock BLOCKS[] = {\n" + blocks + "};\n\n";
+
+    out += "const AotProgram PROGRAM {\n";
+    out += "    .name = \"" + name + "\",\n";
+    out += format("    .fingerprint = 0x%016llXull,\n", (unsigned long long)fingerprint);
+    out += format("    .mode = %s,\n", settings.mode == Mode::SUPER_CHIP ? "Mode::SUPER_CHIP" : "Mode::CHIP_8");
+    out += format("    .quirks = quirksFromBits(%zu),\n", quirkBits(settings.quirks));
+    out += "    .rom = ROM,\n";
+    out += "    .blocks = BLOCKS,\n";
+    out += "};\n\n";
+
+    out += "[[maybe_unused]] const bool registered = AotCode::add(PROGRAM);\n\n}\n";
+
+    return out;
+}
+
+int main(int argc, char* argv[]) {
+    std::string output;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        if (arg.rfind("--output=", 0) == 0) {
+            output = arg.substr(9);
+        }
+    }
+
+    // The ROM is translated for the settings the emulator would run it
+    // with, database profile included.
+    const Settings settings = ArgParser::parse(argc, argv);
+
+    if (settings.rom.empty() || output.empty()) {
+        std::fprintf(stderr, "usage: chip8-aot --output=FILE [emulator options] <rom>\n");
+        return 1;
+    }
+
+    if (settings.mode == Mode::XO_CHIP) {
+        std::fprintf(stderr, "XO-CHIP runs on the interpreter only\n");
+        return 1;
+    }
+
+    MappedFile rom;
+    if (!rom.open(settings.rom)) {
+        std::fprintf(stderr, "Unable to open ROM file\n");
+        return 1;
+    }
+
+    if (rom.bytes().size() > MAX_ROM_SIZE) {
+        std::fprintf(stderr, "ROM too large\n");
+        return 1;
+    }
+
+    Translator translator(rom.bytes(), settings);
+    translator.recoverGraph();
+
+    // The name ends up in a string literal.
+    std::string name = std::filesystem::path(settings.rom).filename().string();
+    std::replace_if(name.begin(), name.end(), [](char ch) {
+        return ch == '"' || ch == '\\' || ch < 0x20;
+    }, '_');
+    const std::string code = translator.emit(name, RomDatabase::fingerprint(rom.bytes()));
+
+    std::FILE* out = std::fopen(output.c_str(), "w");
+    if (out == nullptr) {
+        std::fprintf(stderr, "Unable to open %s\n", output.c_str());
+        return 1;
+    }
+
+    std::fwrite(code.data(), 1, code.size(), out);
+    std::fclose(out);
+
+    std::printf("%s: %zu blocks, %zu of %zu instructions\n", name.c_str(),
+                translator.blockCount(), translator.instructionCount(), rom.bytes().size() / 2);
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "aot_code.h"
+#include "chip8.h"
+
+#include <algorithm>
+#include <cstring>
+
+static std::vector<const AotProgram*>& programs() {
+    static std::vector<const AotProgram*> registered;
+    return registered;
+}
+
+bool AotCode::add(const AotProgram& program) {
+    programs().push_back(&program);
+    return true;
+}
+
+const AotProgram* AotCode::find(uint64_t fingerprint, Mode mode, const Quirks& quirks) {
+    for (const AotProgram* program : programs()) {
+        if (program->fingerprint == fingerprint && program->mode == mode
+            && quirkBits(program->quirks) == quirkBits(quirks)) {
+            return program;
+        }
+    }
+
+    return nullptr;
+}
+
+AotCode::AotCode(const AotProgram& program, std::span<const uint8_t> memory)
+    : program(program), memory(memory), stale(program.blocks.size(), false) {
+    for (size_t i = 0; i < program.blocks.size(); ++i) {
+        const AotBlock& block = program.blocks[i];
+        blockAt[block.pc] = uint16_t(i + 1);
+
+        for (size_t addr = block.pc; addr < size_t(block.pc) + block.length * 2u; ++addr) {
+            covered.set(addr);
+        }
+    }
+}
+
+uint64_t AotCode::step(Chip8& chip8, uint64_t budget) {
+    const uint16_t pc = chip8.PC;
+
+    if (pc >= blockAt.size() || blockAt[pc] == 0 || stale[blockAt[pc] - 1]) {
+        chip8.cycle();
+        return 1;
+    }
+
+    const AotBlock& block = program.blocks[blockAt[pc] - 1];
+    if (block.length > budget) {
+        chip8.cycle();
+        return 1;
+    }
+
+    block.fn(chip8);
+    return block.length;
+}
+
+// A block is stale while its bytes differ from the ROM's, so code that is
+// written back the way it was, as a savestate load does, runs translated
+// again.
+void AotCode::invalidate(size_t first, size_t last) {
+    last = std::min(last, covered.size());
+
+    bool touched = false;
+    for (size_t i = first; i < last && !touched; ++i) {
+        touched = covered[i];
+    }
+
+    if (!touched) {
+        return;
+    }
+
+    for (size_t i = 0; i < program.blocks.size(); ++i) {
+        const AotBlock& block = program.blocks[i];
+        const size_t start = block.pc;
+        const size_t end = start + block.length * 2u;
+
+        if (start < last && end > first) {
+            stale[i] = std::memcmp(&memory[start], &program.rom[start - ROM_START], end - start) != 0;
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "settings.h"
+
+class Chip8;
+
+// The blocks of one ROM translated to C++ by chip8-aot. Each block runs from
+// a leader in the ROM's control-flow graph to a jump, call, return, skip,
+// key wait or memory store, and leaves PC at the next instruction to run.
+using AotBlockFn = void (*)(Chip8& chip8) noexcept;
+
+struct AotBlock {
+    uint16_t pc;
+    uint16_t length;
+    AotBlockFn fn;
+};
+
+// A translation only fits the ROM, mode and quirks it was made for; the
+// quirks are compiled into its code.
+struct AotProgram {
+    const char* name;
+    uint64_t fingerprint;
+    Mode mode;
+    Quirks quirks;
+    std::span<const uint8_t> rom;
+    std::span<const AotBlock> blocks;
+};
+
+// Generated code gets at the Chip8's registers and handlers through a
+// specialization of this, one per translation.
+template <typename Program>
+struct AotBlocks;
+
+// Runs a ROM through the translation linked into the binary for it. Anything
+// the translation does not cover runs on the interpreter: PCs that are not
+// a block's start (Bnnn targets and code the graph never reached) and blocks
+// whose bytes no longer match the ROM because the program rewrote them.
+class AotCode {
+
+    public:
+        // Called by each translation's static initializer.
+        static bool add(const AotProgram& program);
+        static const AotProgram* find(uint64_t fingerprint, Mode mode, const Quirks& quirks);
+
+        AotCode(const AotProgram& program, std::span<const uint8_t> memory);
+
+        // Runs one block (or one interpreted instruction) at the current PC
+        // without exceeding budget, and returns the instructions executed.
+        uint64_t step(Chip8& chip8, uint64_t budget);
+        void invalidate(size_t first, size_t last);
+
+    private:
+        const AotProgram& program;
+        std::span<const uint8_t> memory;
+
+        // Index + 1 of the block starting at each address, or 0.
+        std::array<uint16_t, 4096> blockAt{};
+        std::bitset<4096> covered;
+        std::vector<bool> stale;
+};
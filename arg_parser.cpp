@@ -2,20 +2,94 @@
 
 #include <string>
 #include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+
+#include "mapped_file.h"
+
+// --speed's limit. Faster than this is what turbo is for; a multiplier in
+// the millions would ask for hours of emulated time every frame.
+static constexpr double MAX_SPEED = 100;
 
 Settings ArgParser::parse(int argc, char* argv[]) {
-    Mode mode = Mode::CHIP_8;
+    Settings settings = parse(argc, argv, std::nullopt);
+    if (settings.rom.empty()) {
+        return settings;
+    }
+
+    std::string path = RomDatabase::defaultPath(argv[0]);
+    bool chosen = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--romdb=", 0) == 0) {
+            path = arg.substr(8);
+            chosen = true;
+        }
+    }
+
+    if (path.empty()) {
+        return settings;
+    }
+
+    // A missing default database is no error; one given with --romdb is.
+    try {
+        RomDatabase database(path);
+
+        MappedFile rom;
+        if (!rom.open(settings.rom)) {
+            return settings;
+        }
+
+        if (std::optional<RomDatabase::Profile> profile = database.find(RomDatabase::fingerprint(rom.bytes()))) {
+            settings = parse(argc, argv, profile);
+            if (settings.mode == profile->mode) {
+                std::fprintf(stderr, "Using the ROM database's settings for %s\n", settings.rom.c_str());
+            }
+        }
+    } catch (const std::exception& e) {
+        if (chosen) {
+            std::fprintf(stderr, "%s\n", e.what());
+        }
+    }
+
+    return settings;
+}
+
+Settings ArgParser::parse(int argc, char* argv[], const std::optional<RomDatabase::Profile>& profile) {
+    std::optional<Mode> chosenMode;
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
+        if (arg == "--mode=chip8") {
+            chosenMode = Mode::CHIP_8;
+            break;
+        }
+
         if (arg == "--mode=superchip") {
-            mode = Mode::SUPER_CHIP;
+            chosenMode = Mode::SUPER_CHIP;
+            break;
+        }
+
+        if (arg == "--mode=xochip") {
+            chosenMode = Mode::XO_CHIP;
             break;
         }
     }
 
+    const Mode mode = chosenMode.value_or(profile ? profile->mode : Mode::CHIP_8);
     Settings settings = defaultsForMode(mode);
 
+    // A profile for another mode says nothing about this one.
+    if (profile && profile->mode == mode) {
+        settings.quirks = profile->quirks;
+
+        if (profile->cyclesPerFrame > 0 && profile->cyclesPerFrame <= UINT32_MAX / 60) {
+            settings.cyclesPerSecond = profile->cyclesPerFrame * 60;
+        }
+    }
+
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
 
@@ -23,28 +97,70 @@ Settings ArgParser::parse(int argc, char* argv[]) {
             settings.rom = arg;
         }
 
+        if (arg == "--cpu=jit") {
+            settings.cpu = Cpu::JIT;
+        } else if (arg == "--cpu=threaded") {
+            settings.cpu = Cpu::THREADED;
+        } else if (arg == "--cpu=aot") {
+            settings.cpu = Cpu::AOT;
+        } else if (arg == "--cpu=interpreter") {
+            settings.cpu = Cpu::INTERPRETER;
+        }
+
+        if (arg.rfind("--seed=", 0) == 0) {
+            try {
+                settings.seed = uint32_t(std::stoul(arg.substr(7), nullptr, 0));
+            } catch (const std::exception&) {
+                std::fprintf(stderr, "Invalid seed %s\n", arg.c_str() + 7);
+            }
+        }
+
+        if (arg.rfind("--cpf=", 0) == 0) {
+            try {
+                const unsigned long cpf = std::stoul(arg.substr(6));
+                if (cpf == 0 || cpf > UINT32_MAX / 60) {
+                    throw std::out_of_range("cpf");
+                }
+                settings.cyclesPerSecond = uint32_t(cpf * 60);
+            } catch (const std::exception&) {
+                std::fprintf(stderr, "Invalid cycles per frame %s\n", arg.c_str() + 6);
+            }
+        }
+
+        if (arg.rfind("--speed=", 0) == 0) {
+            try {
+                const double speed = std::stod(arg.substr(8));
+                if (!(speed > 0 && speed <= MAX_SPEED)) {
+                    throw std::out_of_range("speed");
+                }
+                settings.speed = speed;
+            } catch (const std::exception&) {
+                std::fprintf(stderr, "Invalid speed %s\n", arg.c_str() + 8);
+            }
+        }
+
         if (std::optional<bool>  opt = extract("--vfreset=", arg)) {
-            settings.vfReset = *opt;
+            settings.quirks.vfReset = *opt;
         }
 
         if (std::optional<bool>  opt = extract("--memory=", arg)) {
-            settings.memory = *opt;
+            settings.quirks.memory = *opt;
         }
 
         if (std::optional<bool>  opt = extract("--clipping=", arg)) {
-            settings.clipping = *opt;
+            settings.quirks.clipping = *opt;
         }
 
         if (std::optional<bool>  opt = extract("--shift=", arg)) {
-            settings.shift = *opt;
+            settings.quirks.shift = *opt;
         }
 
         if (std::optional<bool>  opt = extract("--jump=", arg)) {
-            settings.jump = *opt;
+            settings.quirks.jump = *opt;
         }
 
         if (std::optional<bool>  opt = extract("--press=", arg)) {
-            settings.press = *opt;
+            settings.quirks.press = *opt;
         }
     }
 
@@ -69,29 +185,28 @@ std::optional<bool> ArgParser::extract(const std::string& option, const std::str
 Settings ArgParser::defaultsForMode(Mode mode) {
     Settings settings {
         .mode = mode,
-        .clipping = true,
-        .press = true,
+        .cpu = Cpu::INTERPRETER,
     };
 
     switch (mode) {
         default: {
-            std::printf("Unknown mode %d\n", mode);
-            std::printf("Defaulting to chip8");
+            std::fprintf(stderr, "Unknown mode %d\n", mode);
+            std::fprintf(stderr, "Defaulting to chip8\n");
         }
         
         case Mode::CHIP_8: {
-            settings.vfReset = true;
-            settings.memory = true;
-            settings.shift = false;
-            settings.jump = false;
+            settings.quirks = CHIP_8_QUIRKS;
             break;
         }
 
         case Mode::SUPER_CHIP: {
-            settings.vfReset = false;
-            settings.memory = false;
-            settings.shift = true;
-            settings.jump = true;
+            settings.quirks = SUPER_CHIP_QUIRKS;
+            break;
+        }
+
+        case Mode::XO_CHIP: {
+            settings.quirks = XO_CHIP_QUIRKS;
+            settings.cyclesPerSecond = 1000 * 60;
             break;
         }
     }
@@ -2,11 +2,17 @@
 
 #include <optional>
 #include "settings.h"
+#include "rom_database.h"
 
 class ArgParser {
     
     public:
+        // Starts from the ROM database's profile for the ROM, if it has one.
+        // --romdb=FILE picks the database and --romdb= turns it off.
         static Settings parse(int argc, char* argv[]);
+        // Starts from the given profile instead, for callers that look ROMs
+        // up themselves. Options on the command line still win.
+        static Settings parse(int argc, char* argv[], const std::optional<RomDatabase::Profile>& profile);
 
     private:
         static Settings defaultsForMode(Mode mode);
@@ -4,8 +4,6 @@
 #include <iostream>
 #include <algorithm>
 
-static SDL_AudioSpec g_have = {};
-
 Audio::~Audio() {
     if (audioDevice) {
         SDL_CloseAudioDevice(audioDevice);
@@ -13,57 +11,90 @@ Audio::~Audio() {
     }
 }
 
-static void SDLCALL audioCallback(void* userdata, Uint8* stream, int len) {
-    SDL_assert(g_have.format  == AUDIO_U8);
-    SDL_assert(g_have.channels == 1);
-
-    auto* beep = static_cast<BeepState*>(userdata);
-
-    SDL_memset(stream, g_have.silence, len);
-
-    const int sampleRate = g_have.freq ? g_have.freq : 44100;
-    const int channels = g_have.channels ? g_have.channels : 1;
-
-    const int frames = len / channels;
-
+void BeepState::render(Uint8* out, int samples, const Sound& sound, int sampleRate, Uint8 silence) {
     const float rampMs = 10.0f;
     const int   rampN  = std::max(1, int(sampleRate * rampMs / 1000.0f));
     const float step   = 1.0f / rampN;
 
-    const float desired = beep->isBeeping ? 1.0f : 0.0f;
+    const float desired = sound.beeping ? 1.0f : 0.0f;
 
     const int frequency = 440;
     const int samplesPerCycle = std::max(1, sampleRate / frequency);
     const int halfCycle = samplesPerCycle / 2;
     const int amp = 5;
 
-    Uint8* out = stream;
-    for (int i = 0; i < frames; ++i) {
-        if (beep->gain < desired)      beep->gain = std::min(beep->gain + step, 1.0f);
-        else if (beep->gain > desired) beep->gain = std::max(beep->gain - step, 0.0f);
+    // The pattern's 128 bits are stepped through at the pitch's rate.
+    const double patternStep = patternRate(sound.pitch) / sampleRate;
+    constexpr double PATTERN_BITS = 128;
+
+    for (int i = 0; i < samples; ++i) {
+        if (gain < desired)      gain = std::min(gain + step, 1.0f);
+        else if (gain > desired) gain = std::max(gain - step, 0.0f);
 
-        int s = (beep->phase < halfCycle) ? (128 + amp) : (128 - amp);
-        int mixed = 128 + int((s - 128) * beep->gain);
+        bool high;
+        if (sound.pattern) {
+            const int bit = int(patternPhase);
+            high = (sound.samples[bit >> 3] >> (7 - (bit & 7))) & 1;
+
+            patternPhase += patternStep;
+            if (patternPhase >= PATTERN_BITS) {
+                patternPhase -= PATTERN_BITS;
+            }
+        } else {
+            high = phase < halfCycle;
+            phase = (phase + 1) % samplesPerCycle;
+        }
+
+        int s = high ? (silence + amp) : (silence - amp);
+        int mixed = silence + int((s - silence) * gain);
 
         out[i] = (Uint8)std::clamp(mixed, 0, 255);
+    }
+}
+
+void SDLCALL Audio::callback(void* userdata, Uint8* stream, int len) {
+    auto* audio = static_cast<Audio*>(userdata);
+
+    SDL_assert(audio->have.format == AUDIO_U8);
+    SDL_assert(audio->have.channels == 1);
+
+    const int sampleRate = audio->have.freq ? audio->have.freq : 44100;
 
-        beep->phase = (beep->phase + 1) % samplesPerCycle;
+    Sound sound;
+    sound.beeping = audio->isBeeping.load(std::memory_order_relaxed);
+    sound.pattern = audio->hasPattern.load(std::memory_order_relaxed);
+    sound.pitch = audio->pitch.load(std::memory_order_relaxed);
+    for (size_t w = 0; w < audio->patternWords.size(); ++w) {
+        const uint64_t word = audio->patternWords[w].load(std::memory_order_relaxed);
+        for (int b = 0; b < 8; ++b) {
+            sound.samples[w * 8 + b] = uint8_t(word >> (56 - 8 * b));
+        }
     }
+
+    audio->beepState.render(stream, len, sound, sampleRate, audio->have.silence);
 }
 
-int Audio::init() {
+int Audio::init(Mode m) {
+    mode = m;
+
     SDL_AudioSpec want;
     SDL_zero(want);
     want.freq = 44100;
     want.format = AUDIO_U8;
     want.channels = 1;
-    want.samples = 512;
-    want.callback = audioCallback;
-    want.userdata = &beepState;
 
-    audioDevice = SDL_OpenAudioDevice(nullptr, 0, &want, &g_have, 0);
+    if (mode == Mode::QUEUE) {
+        want.samples = 128;
+        want.callback = nullptr;
+    } else {
+        want.samples = 512;
+        want.callback = callback;
+        want.userdata = this;
+    }
+
+    audioDevice = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
     if (audioDevice == 0) {
-        std::printf("SDL_OpenAudioDevice error: %s\n", SDL_GetError());
+        std::fprintf(stderr, "SDL_OpenAudioDevice error: %s\n", SDL_GetError());
         return 1;
     }
 
@@ -71,14 +102,52 @@ int Audio::init() {
     return 0;
 }
 
-void Audio::setIsBeeping(const bool beeping) {
-    if (audioDevice) {
-        SDL_LockAudioDevice(audioDevice);
+void Audio::setSound(const Sound& sound) {
+    for (size_t w = 0; w < patternWords.size(); ++w) {
+        uint64_t word = 0;
+        for (int b = 0; b < 8; ++b) {
+            word = (word << 8) | sound.samples[w * 8 + b];
+        }
+        patternWords[w].store(word, std::memory_order_relaxed);
     }
 
-    beepState.isBeeping = beeping;
+    pitch.store(sound.pitch, std::memory_order_relaxed);
+    hasPattern.store(sound.pattern, std::memory_order_relaxed);
+    isBeeping.store(sound.beeping, std::memory_order_relaxed);
+}
 
-    if (audioDevice) {  
-        SDL_UnlockAudioDevice(audioDevice);
+void Audio::queueTick(const Sound& sound) {
+    if (!audioDevice) {
+        return;
     }
+
+    const int samples = std::min(have.freq / TICK_HZ, int(sizeof(tickSamples)));
+    const Uint32 queued = SDL_GetQueuedAudioSize(audioDevice);
+
+    // Running dry means this tick is already late (or is the first), so a
+    // cushion of sound goes in ahead of it to stop the next one being late
+    // too.
+    if (queued == 0) {
+        if (started) {
+            underruns.fetch_add(1, std::memory_order_relaxed);
+        }
+        started = true;
+
+        beepState.render(tickSamples, CUSHION_SAMPLES, sound, have.freq, have.silence);
+        SDL_QueueAudio(audioDevice, tickSamples, CUSHION_SAMPLES);
+    } else if (queued > Uint32(CUSHION_SAMPLES + 2 * samples)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    beepState.render(tickSamples, samples, sound, have.freq, have.silence);
+    SDL_QueueAudio(audioDevice, tickSamples, Uint32(samples));
+}
+
+uint64_t Audio::getUnderruns() const {
+    return underruns.load(std::memory_order_relaxed);
+}
+
+uint64_t Audio::getDropped() const {
+    return dropped.load(std::memory_order_relaxed);
 }
@@ -1,20 +1,69 @@
 #include <SDL.h>
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "sound.h"
+
+// The buzzer and pattern generator. Only ever touched by one thread at a
+// time: the audio callback, or the emulation thread in queue mode.
 struct BeepState {
-    bool isBeeping = false;
     int phase = 0;
+    double patternPhase = 0;
     float gain = 0.0f;
-    float target = 0.0f;
+
+    // Fills out with samples of the buzzer, or of the sound's pattern if it
+    // has one, ramping the gain towards on or off.
+    void render(Uint8* out, int samples, const Sound& sound, int sampleRate, Uint8 silence);
 };
 
 class Audio {
 
     public:
+        // CALLBACK has SDL pull samples and only sees the beep state when it
+        // asks, in 512-sample steps. QUEUE pushes one timer tick of samples
+        // from the emulation thread on each tick, through a small device
+        // buffer, so beeps start and stop on the tick they were set on.
+        enum class Mode { CALLBACK, QUEUE };
+
         ~Audio();
-        int init();
-        void setIsBeeping(const bool beeping);
+        int init(Mode mode = Mode::CALLBACK);
+
+        // CALLBACK mode: the sound for the next samples. Lock-free, so it
+        // can be called as often as needed from any thread.
+        void setSound(const Sound& sound);
+
+        // QUEUE mode: one 60 Hz timer tick's worth of sound, from the thread
+        // that ticks the timers.
+        void queueTick(const Sound& sound);
+
+        // Times the queue ran dry before the next tick arrived, and ticks
+        // dropped because the queue was already full (e.g. in turbo).
+        uint64_t getUnderruns() const;
+        uint64_t getDropped() const;
 
     private:
+        static constexpr int TICK_HZ = 60;
+        // Queue mode keeps between CUSHION and CUSHION plus two ticks of
+        // samples queued.
+        static constexpr int CUSHION_SAMPLES = 256;
+
+        Mode mode = Mode::CALLBACK;
         BeepState beepState;
-        SDL_AudioDeviceID audioDevice;
-};
\ No newline at end of file
+        std::atomic<bool> isBeeping{false};
+        // The pattern is kept as two words, so it can change under the
+        // callback without a lock; a torn update lasts one buffer at most.
+        std::atomic<bool> hasPattern{false};
+        std::array<std::atomic<uint64_t>, 2> patternWords{};
+        std::atomic<uint8_t> pitch{64};
+        SDL_AudioSpec have{};
+        SDL_AudioDeviceID audioDevice = 0;
+
+        Uint8 tickSamples[4096];
+        bool started = false;
+        std::atomic<uint64_t> underruns{0};
+        std::atomic<uint64_t> dropped{0};
+
+        static void SDLCALL callback(void* userdata, Uint8* stream, int len);
+};
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chip8.h"
+#include "arg_parser.h"
+#include "mapped_file.h"
+#include "rom_database.h"
+#include "thread_pool.h"
+
+// Runs a set of ROMs headless, as fast as the host allows, and prints one JSON
+// object per ROM. Timers tick once per frame, with frames and instructions
+// paced the same way as the real-time loop, --cpf included.
+static constexpr uint64_t FRAME_HZ = 60;
+
+static constexpr uint64_t DEFAULT_FRAMES = 600;
+
+struct BatchResult {
+    std::string rom;
+    std::string error;
+    uint64_t hash = 0;
+    bool profiled = false;
+    uint64_t instructions = 0;
+    uint64_t frames = 0;
+    double seconds = 0;
+};
+
+// FNV-1a over the framebuffer words. XO-CHIP's second plane only counts
+// when something is on it, so hashes from the other modes stay as they were.
+static uint64_t hashDisplay(const DisplayPlanes& planes) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (size_t p = 0; p < planes.size(); ++p) {
+        if (p > 0 && planes[p] == DisplayBuffer{}) {
+            continue;
+        }
+
+        for (const DisplayRow& row : planes[p]) {
+            for (uint64_t word : row) {
+                for (int i = 0; i < 8; ++i) {
+                    hash ^= (word >> (i * 8)) & 0xFF;
+                    hash *= 0x100000001B3ull;
+                }
+            }
+        }
+    }
+
+    return hash;
+}
+
+static std::string jsonEscape(const std::string& s) {
+    std::string out;
+
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += char(c);
+        } else if (c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += char(c);
+        }
+    }
+
+    return out;
+}
+
+static bool isRomFile(const std::filesystem::path& path) {
+    const std::string ext = path.extension().string();
+    return ext == ".ch8" || ext == ".c8" || ext == ".sc8";
+}
+
+// Directories are searched recursively for ROMs, in a stable order so runs
+// can be diffed against each other.
+static std::vector<std::string> collectRoms(const std::vector<std::string>& inputs) {
+    std::vector<std::string> roms;
+
+    for (const std::string& input : inputs) {
+        std::error_code ec;
+
+        if (!std::filesystem::is_directory(input, ec)) {
+            roms.push_back(input);
+            continue;
+        }
+
+        std::vector<std::string> found;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(input, ec)) {
+            if (entry.is_regular_file() && isRomFile(entry.path())) {
+                found.push_back(entry.path().string());
+            }
+        }
+
+        std::sort(found.begin(), found.end());
+        roms.insert(roms.end(), found.begin(), found.end());
+    }
+
+    return roms;
+}
+
+#ifdef CHIP8_OPCODE_STATS
+// Counters from every ROM, written to stderr once the batch is done.
+static OpcodeStats opcodeStats;
+static std::mutex opcodeStatsMutex;
+#endif
+
+// Each ROM gets its own profile from the database, under the same options.
+static void runRom(int argc, char* argv[], const RomDatabase* database, uint64_t cycleBudget, uint64_t frameBudget, BatchResult& result) {
+    try {
+        MappedFile rom;
+        if (!rom.open(result.rom)) {
+            throw std::runtime_error("Unable to open ROM file");
+        }
+
+        std::optional<RomDatabase::Profile> profile;
+        if (database != nullptr) {
+            profile = database->find(RomDatabase::fingerprint(rom.bytes()));
+        }
+
+        Settings settings = ArgParser::parse(argc, argv, profile);
+        settings.rom = result.rom;
+        result.profiled = profile && profile->mode == settings.mode;
+
+        // Hashes are only comparable between runs if Cxkk draws the same numbers.
+        if (!settings.seed) {
+            settings.seed = 0;
+        }
+
+        Chip8 chip8(settings);
+        chip8.init(rom.bytes());
+
+        const auto start = std::chrono::steady_clock::now();
+        uint64_t executed = 0;
+        uint64_t frame = 0;
+
+        while (executed < cycleBudget && frame < frameBudget && !chip8.isHalted()) {
+            const uint64_t target = std::min(cycleBudget, (frame + 1) * settings.cyclesPerSecond / FRAME_HZ);
+            chip8.run(target - executed);
+            chip8.tickTimers();
+
+            executed = target;
+            frame++;
+        }
+
+        const auto end = std::chrono::steady_clock::now();
+
+        if (const char* error = chip8.getError()) {
+            throw std::runtime_error(error);
+        }
+
+        result.hash = hashDisplay(chip8.getDisplayPlanes());
+        result.instructions = executed;
+        result.frames = frame;
+        result.seconds = std::chrono::duration<double>(end - start).count();
+
+#ifdef CHIP8_OPCODE_STATS
+        std::lock_guard<std::mutex> lock(opcodeStatsMutex);
+        opcodeStats.merge(chip8.getOpcodeStats());
+#endif
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+}
+
+static void printResult(std::FILE* out, const BatchResult& result) {
+    if (!result.error.empty()) {
+        std::fprintf(out, "{\"rom\":\"%s\",\"error\":\"%s\"}\n",
+                     jsonEscape(result.rom).c_str(), jsonEscape(result.error).c_str());
+        return;
+    }
+
+    const double mips = result.seconds > 0 ? result.instructions / result.seconds / 1e6 : 0;
+
+    std::fprintf(out, "{\"rom\":\"%s\",\"hash\":\"%016llx\",%s\"instructions\":%llu,\"frames\":%llu,\"seconds\":%.6f,\"mips\":%.2f}\n",
+                 jsonEscape(result.rom).c_str(), (unsigned long long)result.hash,
+                 result.profiled ? "\"romdb\":true," : "",
+                 (unsigned long long)result.instructions, (unsigned long long)result.frames,
+                 result.seconds, mips);
+}
+
+static bool parseCount(const std::string& arg, const std::string& option, uint64_t& value) {
+    if (arg.rfind(option, 0) != 0) {
+        return false;
+    }
+
+    value = std::stoull(arg.substr(option.size()));
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t cycleBudget = UINT64_MAX;
+    uint64_t frameBudget = UINT64_MAX;
+    uint64_t threads = std::thread::hardware_concurrency();
+    std::string output;
+    std::string databasePath = RomDatabase::defaultPath(argv[0]);
+    bool databaseChosen = false;
+    std::vector<std::string> inputs;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+
+            if (arg[0] != '-') {
+                inputs.push_back(arg);
+            } else if (arg.rfind("--output=", 0) == 0) {
+                output = arg.substr(9);
+            } else if (arg.rfind("--romdb=", 0) == 0) {
+                databasePath = arg.substr(8);
+                databaseChosen = true;
+            } else {
+                parseCount(arg, "--cycles=", cycleBudget);
+                parseCount(arg, "--frames=", frameBudget);
+                parseCount(arg, "--threads=", threads);
+            }
+        }
+    } catch (const std::exception&) {
+        std::fprintf(stderr, "Invalid number in arguments\n");
+        return 1;
+    }
+
+    if (cycleBudget == UINT64_MAX && frameBudget == UINT64_MAX) {
+        frameBudget = DEFAULT_FRAMES;
+    }
+
+    const std::vector<std::string> roms = collectRoms(inputs);
+    if (roms.empty()) {
+        std::fprintf(stderr, "usage: chip8-batch [--cycles=N | --frames=N] [--threads=N] [--output=FILE] [emulator options] <rom|dir>...\n");
+        return 1;
+    }
+
+    // A missing default database is no error; one given with --romdb is.
+    std::unique_ptr<RomDatabase> database;
+    if (!databasePath.empty()) {
+        try {
+            database = std::make_unique<RomDatabase>(databasePath);
+        } catch (const std::exception& e) {
+            if (databaseChosen) {
+                std::fprintf(stderr, "%s\n", e.what());
+                return 1;
+            }
+        }
+    }
+
+    std::FILE* out = stdout;
+    if (!output.empty()) {
+        out = std::fopen(output.c_str(), "w");
+        if (out == nullptr) {
+            std::fprintf(stderr, "Unable to open %s\n", output.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<BatchResult> results(roms.size());
+    for (size_t i = 0; i < roms.size(); ++i) {
+        results[i].rom = roms[i];
+    }
+
+    ThreadPool pool(threads);
+    pool.run(results.size(), [&](size_t i) {
+        runRom(argc, argv, database.get(), cycleBudget, frameBudget, results[i]);
+    });
+
+    // Results are written in input order, whichever thread finished first.
+    int failures = 0;
+    for (const BatchResult& result : results) {
+        printResult(out, result);
+        failures += !result.error.empty();
+    }
+
+    if (out != stdout) {
+        std::fclose(out);
+    }
+
+#ifdef CHIP8_OPCODE_STATS
+    opcodeStats.write(stderr);
+#endif
+
+    return failures > 0 ? 1 : 0;
+}
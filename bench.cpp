@@ -0,0 +1,458 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chip8.h"
+#include "lockstep.h"
+#include "snapshot_library.h"
+#include "rom_database.h"
+
+// A fixed workload that loops forever over a typical instruction mix: ALU ops,
+// I arithmetic, a skip-guarded sprite draw, a subroutine call and timer access.
+static const std::vector<uint8_t> BENCH_ROM = {
+    0x00, 0xE0, // 200: CLS
+    0x60, 0x00, // 202: V0 = 0
+    0x61, 0x01, // 204: V1 = 1
+    0x62, 0x08, // 206: V2 = 8
+    0x67, 0x0F, // 208: V7 = 0x0F
+    0x70, 0x01, // 20A: V0 += 1
+    0x83, 0x14, // 20C: V3 += V1
+    0xF3, 0x29, // 20E: I = font sprite for V3
+    0x85, 0x3E, // 210: V5 = V3 << 1
+    0xF4, 0x1E, // 212: I += V4
+    0xA2, 0x50, // 214: I = 0x250
+    0x86, 0x00, // 216: V6 = V0
+    0x86, 0x72, // 218: V6 &= V7
+    0x46, 0x00, // 21A: skip if V6 != 0
+    0xD1, 0x25, // 21C: draw 5 rows at V1, V2
+    0x22, 0x40, // 21E: call 0x240
+    0x12, 0x0A, // 220: jump 0x20A
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xF8, 0x33, // 240: BCD V8 at I
+    0xF9, 0x15, // 242: delay = V9
+    0xFA, 0x07, // 244: VA = delay
+    0x00, 0xEE, // 246: return
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 250: sprite
+};
+
+// A draw-bound workload: sprites walking diagonally across the screen, the
+// way most games spend their frames.
+static const std::vector<uint8_t> SPRITE_ROM = {
+    0xA2, 0x20, // 200: I = 0x220
+    0x60, 0x00, // 202: V0 = 0
+    0x61, 0x00, // 204: V1 = 0
+    0xD0, 0x18, // 206: draw 8 rows at V0, V1
+    0x70, 0x05, // 208: V0 += 5
+    0x71, 0x03, // 20A: V1 += 3
+    0xD0, 0x18, // 20C: draw 8 rows at V0, V1
+    0x70, 0x07, // 20E: V0 += 7
+    0x71, 0x02, // 210: V1 += 2
+    0x12, 0x06, // 212: jump 0x206
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x3C, 0x7E, 0xDB, 0xFF, 0xBD, 0xC3, 0x7E, 0x3C, // 220: sprite
+};
+
+// An XO-CHIP workload: 16x16 sprites drawn on both planes from data above
+// 4 KB, with a long I load that a skip has to step over, and a register
+// range load every pass.
+static const std::vector<uint8_t> XO_ROM = [] {
+    std::vector<uint8_t> rom = {
+        0x00, 0xFF,             // 200: hires
+        0xF3, 0x01,             // 202: draw on both planes
+        0xF0, 0x00, 0x10, 0x00, // 204: I = 0x1000
+        0x60, 0x00,             // 208: V0 = 0
+        0x61, 0x00,             // 20A: V1 = 0
+        0xD0, 0x10,             // 20C: draw 16x16 at V0, V1
+        0x70, 0x05,             // 20E: V0 += 5
+        0x71, 0x03,             // 210: V1 += 3
+        0x52, 0x33,             // 212: load V2..V3 from I
+        0x30, 0xFF,             // 214: skip if V0 == 0xFF
+        0xF0, 0x00, 0x10, 0x00, // 216: I = 0x1000
+        0x12, 0x0C,             // 21A: jump 0x20C
+    };
+
+    rom.resize(0x1000 - ROM_START);
+    for (int i = 0; i < 64; ++i) {
+        rom.push_back(uint8_t(0x3C ^ (i * 0x25)));
+    }
+
+    return rom;
+}();
+
+static constexpr uint64_t BENCH_CYCLES = 20'000'000;
+static constexpr uint64_t BENCH_CHUNK = 1000;
+
+// Every result is printed as it comes in and collected for the JSON report.
+struct BenchResult {
+    std::string name;
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+static std::vector<BenchResult> results;
+
+static void report(const std::string& name, std::vector<std::pair<std::string, double>> metrics) {
+    std::printf("%-32s", name.c_str());
+    for (const auto& [metric, value] : metrics) {
+        std::printf(" %s %.3f", metric.c_str(), value);
+    }
+    std::printf("\n");
+
+    results.push_back(BenchResult { name, std::move(metrics) });
+}
+
+static bool writeJson(const std::string& path) {
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (out == nullptr) {
+        return false;
+    }
+
+    std::fprintf(out, "{\n  \"compiler\": \"%s\",\n  \"results\": [\n", __VERSION__);
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::fprintf(out, "    {\"name\": \"%s\"", results[i].name.c_str());
+        for (const auto& [metric, value] : results[i].metrics) {
+            std::fprintf(out, ", \"%s\": %.6g", metric.c_str(), value);
+        }
+        std::fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+
+    return std::fclose(out) == 0;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void benchRom(const char* workload, const std::vector<uint8_t>& rom, const char* name, Cpu cpu,
+                     Mode mode = Mode::CHIP_8, Quirks quirks = CHIP_8_QUIRKS) {
+    Settings settings {
+        .mode = mode,
+        .cpu = cpu,
+        .rom = {},
+        .quirks = quirks,
+        .seed = 1,
+    };
+
+    Chip8 chip8(settings);
+    chip8.init(rom);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < BENCH_CYCLES; i += BENCH_CHUNK) {
+        chip8.run(BENCH_CHUNK);
+    }
+    const double seconds = secondsSince(start);
+
+    // The instructions per 60 Hz frame this rate could sustain in real time.
+    report(std::string("rom/") + workload + "/" + name, {
+        { "mips", BENCH_CYCLES / seconds / 1e6 },
+        { "ns_per_op", seconds * 1e9 / BENCH_CYCLES },
+        { "realtime_cpf", BENCH_CYCLES / seconds / 60 },
+    });
+}
+
+// A microbenchmark is one instruction repeated MICRO_REPEAT times in a loop,
+// after some setup, so the jump back costs under 2% of the time. They run on
+// the interpreter with SCHIP quirks, which leave I alone on Fx55/Fx65.
+struct Micro {
+    const char* name;
+    std::vector<uint8_t> setup;
+    uint8_t hi;
+    uint8_t lo;
+};
+
+static constexpr size_t MICRO_REPEAT = 64;
+static constexpr uint64_t MICRO_CYCLES = 4'000'000;
+static constexpr size_t MICRO_DATA = 0x600 - ROM_START;
+
+// Sprite data for the draw benchmarks, at 0x600.
+static constexpr uint8_t MICRO_SPRITE[32] = {
+    0x3C, 0x7E, 0xDB, 0xFF, 0xBD, 0xC3, 0x7E, 0x3C, 0x18, 0x3C, 0x7E, 0xFF, 0x18, 0x18, 0x24, 0x42,
+    0x0F, 0xF0, 0x33, 0xCC, 0x55, 0xAA, 0xFF, 0x00, 0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81,
+};
+
+static const std::vector<Micro> MICROS = {
+    { "6xkk",               {},                                     0x6A, 0x42 },
+    { "7xkk",               {},                                     0x7A, 0x01 },
+    { "8xy4",               { 0x6A, 0x10, 0x6B, 0x37 },             0x8A, 0xB4 },
+    { "8xy6",               { 0x6A, 0x5A },                         0x8A, 0xB6 },
+    { "Annn",               {},                                     0xA6, 0x00 },
+    { "Fx1E",               { 0xA6, 0x00, 0x6A, 0x00 },             0xFA, 0x1E },
+    { "Fx33",               { 0xA7, 0x00, 0x6A, 0x9F },             0xFA, 0x33 },
+    { "Fx55",               { 0xA7, 0x00 },                         0xFF, 0x55 },
+    { "Fx65",               { 0xA6, 0x00 },                         0xFF, 0x65 },
+    { "Dxyn/lores",         { 0xA6, 0x00, 0x60, 0x1D, 0x61, 0x08 }, 0xD0, 0x1F },
+    { "Dxyn/hires",         { 0x00, 0xFF, 0xA6, 0x00, 0x60, 0x3D, 0x61, 0x10 }, 0xD0, 0x1F },
+    { "Dxy0/hires-16x16",   { 0x00, 0xFF, 0xA6, 0x00, 0x60, 0x3D, 0x61, 0x10 }, 0xD0, 0x10 },
+    { "00E0/hires",         { 0x00, 0xFF },                         0x00, 0xE0 },
+    { "00CN/hires",         { 0x00, 0xFF },                         0x00, 0xC4 },
+    { "00FB/hires",         { 0x00, 0xFF },                         0x00, 0xFB },
+    { "00FC/hires",         { 0x00, 0xFF },                         0x00, 0xFC },
+};
+
+static void benchMicro(const Micro& micro) {
+    std::vector<uint8_t> rom = micro.setup;
+    const uint16_t loop = uint16_t(ROM_START + rom.size());
+
+    for (size_t i = 0; i < MICRO_REPEAT; ++i) {
+        rom.push_back(micro.hi);
+        rom.push_back(micro.lo);
+    }
+    rom.push_back(uint8_t(0x10 | loop >> 8));
+    rom.push_back(uint8_t(loop & 0xFF));
+
+    rom.resize(MICRO_DATA);
+    rom.insert(rom.end(), std::begin(MICRO_SPRITE), std::end(MICRO_SPRITE));
+
+    Settings settings {
+        .mode = Mode::SUPER_CHIP,
+        .cpu = Cpu::INTERPRETER,
+        .rom = {},
+        .quirks = SUPER_CHIP_QUIRKS,
+        .seed = 1,
+    };
+
+    Chip8 chip8(settings);
+    chip8.init(rom);
+    chip8.run(micro.setup.size() / 2);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < MICRO_CYCLES; i += BENCH_CHUNK) {
+        chip8.run(BENCH_CHUNK);
+    }
+    const double seconds = secondsSince(start);
+
+    report(std::string("op/") + micro.name, {
+        { "ns_per_op", seconds * 1e9 / MICRO_CYCLES },
+    });
+}
+
+static constexpr int DRAW_FRAMES = 100'000;
+
+// The pixel expansion Window::draw does for the given number of dirty rows,
+// on a busy screen with one or both planes in use. The texture upload and
+// present need a real window and are not included.
+static void benchDraw(const char* name, bool hires, int rows, int planeCount) {
+    DisplayPlanes planes{};
+    for (int p = 0; p < planeCount; ++p) {
+        for (size_t y = 0; y < planes[p].size(); ++y) {
+            planes[p][y] = { 0xF0F0A5A5C3C3FF00ull ^ (y * 0x0101010101010101ull) ^ p, 0x123456789ABCDEF0ull << ((y + p) & 7) };
+        }
+    }
+
+    const int width = displayWidth(hires);
+    const std::array<uint32_t, 4> palette = { 0xC8C3BEFF, 0x000000FF, 0xC85A3CFF, 0x642D1EFF };
+    std::vector<uint32_t> pixels(128 * 64);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < DRAW_FRAMES; ++frame) {
+        planes[0][frame & 63][0] ^= 1;
+        expandPixels(planes, width, 0, rows - 1, palette, pixels.data(), 128 * 4);
+    }
+    const double seconds = secondsSince(start);
+
+    report(std::string("draw/") + name, {
+        { "ns_per_frame", seconds * 1e9 / DRAW_FRAMES },
+    });
+}
+
+// Runs many copies of the fixed ROM, each with a different keypad state, and
+// reports the combined instruction rate across all of them.
+static void benchLockstep(size_t instances) {
+    Settings settings {
+        .mode = Mode::CHIP_8,
+        .cpu = Cpu::INTERPRETER,
+        .rom = {},
+        .quirks = CHIP_8_QUIRKS,
+        .seed = 1,
+    };
+
+    Lockstep lockstep(settings, instances, 1);
+    for (size_t i = 0; i < instances; ++i) {
+        lockstep.setKeypad(i, uint16_t(i));
+    }
+    lockstep.init(BENCH_ROM);
+
+    const uint64_t cycles = BENCH_CYCLES / instances;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < cycles; i += BENCH_CHUNK) {
+        lockstep.run(BENCH_CHUNK);
+    }
+    const double seconds = secondsSince(start);
+
+    const uint64_t total = lockstep.groupInstructions() + lockstep.scalarInstructions();
+    report("lockstep/" + std::to_string(instances), {
+        { "mips", total / seconds / 1e6 },
+        { "grouped_percent", 100.0 * lockstep.groupInstructions() / total },
+    });
+}
+
+static constexpr int SNAPSHOT_ROUNDS = 100'000;
+static constexpr size_t LIBRARY_STATES = 1000;
+
+// Times in-memory savestates and restores from a memory-mapped library.
+static void benchSavestates() {
+    Settings settings {
+        .mode = Mode::CHIP_8,
+        .cpu = Cpu::INTERPRETER,
+        .rom = {},
+        .quirks = CHIP_8_QUIRKS,
+        .seed = 1,
+    };
+
+    Chip8 chip8(settings);
+    chip8.init(BENCH_ROM);
+    chip8.run(BENCH_CHUNK);
+
+    std::vector<uint8_t> state;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < SNAPSHOT_ROUNDS; ++i) {
+        chip8.saveState(state);
+    }
+    const double save = secondsSince(start) * 1e6 / SNAPSHOT_ROUNDS;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < SNAPSHOT_ROUNDS; ++i) {
+        chip8.loadState(state);
+    }
+    const double load = secondsSince(start) * 1e6 / SNAPSHOT_ROUNDS;
+
+    report("savestate", {
+        { "bytes", double(state.size()) },
+        { "save_us", save },
+        { "load_us", load },
+    });
+
+    std::vector<std::vector<uint8_t>> states;
+    for (size_t i = 0; i < LIBRARY_STATES; ++i) {
+        chip8.run(BENCH_CHUNK);
+        states.push_back(chip8.saveState());
+    }
+
+    const std::string path = (std::filesystem::temp_directory_path() / "chip8-bench.snap").string();
+    SnapshotLibrary::write(path, states);
+
+    double restore = 0;
+    {
+        SnapshotLibrary library(path);
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < library.size(); ++i) {
+            chip8.loadState(library.get(i));
+            chip8.run(BENCH_CHUNK);
+        }
+        restore = secondsSince(start) * 1e6 / LIBRARY_STATES;
+    }
+
+    std::filesystem::remove(path);
+
+    // Each restore is followed by a BENCH_CHUNK-instruction run.
+    report("snapshot-library", {
+        { "restore_and_run_us", restore },
+    });
+}
+
+static constexpr size_t DATABASE_ENTRIES = 50'000;
+static constexpr int DATABASE_ROUNDS = 1000;
+
+// Times what a ROM database adds to startup: opening the database, mapping
+// and fingerprinting the ROM and finding its profile, against a database far
+// bigger than any real ROM collection.
+static void benchRomDatabase() {
+    std::vector<RomDatabase::Entry> entries;
+    for (size_t i = 0; i < DATABASE_ENTRIES; ++i) {
+        const uint64_t hash = (i + 1) * 0x9E3779B97F4A7C15ull;
+        entries.push_back(RomDatabase::Entry { hash, { Mode::SUPER_CHIP, SUPER_CHIP_QUIRKS, 30 } });
+    }
+    entries.push_back(RomDatabase::Entry { RomDatabase::fingerprint(BENCH_ROM), { Mode::CHIP_8, CHIP_8_QUIRKS, 0 } });
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    const std::string databasePath = (dir / "chip8-bench.db").string();
+    const std::string romPath = (dir / "chip8-bench.ch8").string();
+
+    RomDatabase::write(databasePath, entries);
+    std::ofstream(romPath, std::ios::binary).write(reinterpret_cast<const char*>(BENCH_ROM.data()), std::streamsize(BENCH_ROM.size()));
+
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < DATABASE_ROUNDS; ++i) {
+        RomDatabase database(databasePath);
+        MappedFile rom;
+        rom.open(romPath);
+        found += database.find(RomDatabase::fingerprint(rom.bytes())).has_value();
+    }
+    const double startup = secondsSince(start) * 1e6 / DATABASE_ROUNDS;
+
+    double lookup = 0;
+    {
+        RomDatabase database(databasePath);
+
+        start = std::chrono::steady_clock::now();
+        for (const RomDatabase::Entry& entry : entries) {
+            found += database.find(entry.hash).has_value();
+        }
+        lookup = secondsSince(start) * 1e9 / entries.size();
+    }
+
+    std::filesystem::remove(databasePath);
+    std::filesystem::remove(romPath);
+
+    if (found != DATABASE_ROUNDS + entries.size()) {
+        std::fprintf(stderr, "ROM database lookups failed\n");
+    }
+
+    report("romdb", {
+        { "entries", double(entries.size()) },
+        { "startup_us", startup },
+        { "lookup_ns", lookup },
+    });
+}
+
+int main(int argc, char* argv[]) {
+    std::string output;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        if (arg.rfind("--output=", 0) == 0) {
+            output = arg.substr(9);
+        }
+    }
+
+    for (const Micro& micro : MICROS) {
+        benchMicro(micro);
+    }
+
+    benchRom("alu", BENCH_ROM, "interpreter", Cpu::INTERPRETER);
+    benchRom("alu", BENCH_ROM, "threaded", Cpu::THREADED);
+    benchRom("alu", BENCH_ROM, "jit", Cpu::JIT);
+    benchRom("sprites", SPRITE_ROM, "interpreter", Cpu::INTERPRETER);
+    benchRom("sprites", SPRITE_ROM, "threaded", Cpu::THREADED);
+    benchRom("sprites", SPRITE_ROM, "jit", Cpu::JIT);
+    benchRom("xochip", XO_ROM, "interpreter", Cpu::INTERPRETER, Mode::XO_CHIP, XO_CHIP_QUIRKS);
+
+    benchDraw("lores", false, 32, 1);
+    benchDraw("hires", true, 64, 1);
+    benchDraw("sprite", true, 8, 1);
+    benchDraw("xochip", true, 64, 2);
+
+    benchLockstep(1000);
+    benchSavestates();
+    benchRomDatabase();
+
+    if (!output.empty() && !writeJson(output)) {
+        std::fprintf(stderr, "Unable to write %s\n", output.c_str());
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,34 +1,95 @@
 #include "chip8.h"
-
-#include <fstream>
-
-Chip8::Chip8(Settings s) : rng(std::random_device{}()), randByte(0, 255) {
-    displayBufferUpdated = false;
+#include "threaded.h"
+#include "mapped_file.h"
+#include "rom_database.h"
+#include "profiler.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+Chip8::Chip8(Settings s) : rng(xorshiftSeed(s.seed ? *s.seed : std::random_device{}())) {
+    dirtyRows = 0;
     delayTimer = 0;
     soundTimer = 0;
     PC = ROM_START;
+    I = 0;
     SP = 0;
+    V.fill(0);
     settings = s;
     hires = false;
     halted = false;
+    planeMask = 1;
+    patternLoaded = false;
+    pitch = 64;
+
+    const bool xo = settings.mode == Mode::XO_CHIP;
+    handlers = xo ? QUIRK_HANDLERS<true>[quirkBits(settings.quirks)]
+                  : QUIRK_HANDLERS<false>[quirkBits(settings.quirks)];
+
+    memory.assign(memorySize(settings.mode), 0);
+    decodeCache.assign(memory.size(), CachedOp{});
+    addressMask = uint16_t(memory.size() - 1);
+
+    // The translated backends are built around 4 KB of memory and two-byte
+    // instructions.
+    if (xo && settings.cpu != Cpu::INTERPRETER) {
+        std::fprintf(stderr, "XO-CHIP runs on the interpreter only\n");
+    } else if (settings.cpu == Cpu::JIT) {
+        if (Jit::supported()) {
+            jit = std::make_unique<Jit>();
+        } else {
+            std::fprintf(stderr, "JIT not supported on this platform, using the interpreter\n");
+        }
+    } else if (settings.cpu == Cpu::THREADED) {
+        threaded = std::make_unique<ThreadedCode>();
+    }
 }
 
-void Chip8::init() {
-    std::copy(FONTSET.begin(), FONTSET.end(), memory.begin() + FONT_START);
-    std::copy(BIGFONTSET.begin(), BIGFONTSET.end(), memory.begin() + BIGFONT_START);
+Chip8::~Chip8() = default;
 
-    std::ifstream rom(settings.rom, std::ios::binary | std::ios::ate);
-    if (!rom) {
+void Chip8::init() {
+    MappedFile rom;
+    if (!rom.open(settings.rom)) {
         throw std::runtime_error("Unable to open ROM file");
     }
 
-    std::streamsize size = rom.tellg();
-    if (size > static_cast<std::streamsize>(MAX_ROM_SIZE)) {
+    init(rom.bytes());
+}
+
+void Chip8::init(std::span<const uint8_t> rom) {
+    if (rom.size() > maxRomSize(settings.mode)) {
         throw std::runtime_error("ROM too large");
     }
 
-    rom.seekg(0, std::ios::beg);
-    rom.read(reinterpret_cast<char*>(&memory[ROM_START]), size);
+    std::copy(FONTSET.begin(), FONTSET.end(), memory.begin() + FONT_START);
+    std::copy(BIGFONTSET.begin(), BIGFONTSET.end(), memory.begin() + BIGFONT_START);
+    std::copy(rom.begin(), rom.end(), memory.begin() + ROM_START);
+
+    // Translations are linked in per ROM, so which one applies is only
+    // known once the ROM is.
+    if (settings.cpu == Cpu::AOT && settings.mode != Mode::XO_CHIP) {
+        aot.reset();
+
+        const uint64_t fingerprint = RomDatabase::fingerprint(rom);
+        if (const AotProgram* program = AotCode::find(fingerprint, settings.mode, settings.quirks)) {
+            aot = std::make_unique<AotCode>(*program, memory);
+        } else {
+            std::fprintf(stderr, "No ahead-of-time translation of this ROM with these settings, using the interpreter\n");
+        }
+    }
+
+    invalidateCache(0, memory.size());
+
+    if (jit) {
+        jit->reset();
+    }
+
+    if (threaded) {
+        threaded->reset();
+    }
 }
 
 void Chip8::tickTimers() {
@@ -50,120 +111,547 @@ bool Chip8::isHires() const {
 }
 
 int Chip8::screenWidth() const {
-    return hires ? 128 : 64;
+    return displayWidth(hires);
 }
 
 int Chip8::screenHeight() const {
-    return hires ? 64 : 32;
+    return displayHeight(hires);
 }
 
 bool Chip8::isHalted() const {
     return halted;
 }
 
-const std::array<std::array<uint8_t, 128>, 64>& Chip8::getDisplayBuffer() {
-    return displayBuffer;
+const char* Chip8::getError() const {
+    return error;
+}
+
+const DisplayBuffer& Chip8::getDisplayBuffer() {
+    return planes[0];
+}
+
+const DisplayPlanes& Chip8::getDisplayPlanes() const {
+    return planes;
+}
+
+Sound Chip8::getSound() const {
+    return Sound{isBeeping(), patternLoaded, pattern, pitch};
+}
+
+static constexpr char STATE_MAGIC[4] = {'C', '8', 'S', 'T'};
+
+void Chip8::saveState(std::vector<uint8_t>& state) const {
+    state.resize(stateSize(settings.mode));
+    uint8_t* p = state.data();
+
+    auto put = [&p](uint64_t value, int bytes) {
+        for (int b = 0; b < bytes; ++b) {
+            *p++ = uint8_t(value >> (8 * b));
+        }
+    };
+
+    auto keyBits = [](const std::array<uint8_t, 16>& keys) {
+        uint16_t bits = 0;
+        for (int k = 0; k < 16; ++k) {
+            bits |= uint16_t(keys[k] != 0) << k;
+        }
+        return bits;
+    };
+
+    std::memcpy(p, STATE_MAGIC, sizeof(STATE_MAGIC));
+    p += sizeof(STATE_MAGIC);
+    put(STATE_VERSION, 2);
+
+    put(PC, 2);
+    put(I, 2);
+    put(SP, 1);
+    for (uint8_t v : V) put(v, 1);
+    for (uint16_t s : stack) put(s, 2);
+    for (uint8_t r : RPL) put(r, 1);
+
+    put(delayTimer, 1);
+    put(soundTimer, 1);
+    put(hires, 1);
+    put(halted, 1);
+    put(keyBits(keypad), 2);
+    put(keyBits(prevKeypad), 2);
+    put(rng, 4);
+
+    put(planeMask, 1);
+    put(patternLoaded, 1);
+    put(pitch, 1);
+    for (uint8_t b : pattern) put(b, 1);
+
+    std::memcpy(p, memory.data(), memory.size());
+    p += memory.size();
+
+    for (const DisplayBuffer& plane : planes) {
+        for (const DisplayRow& row : plane) {
+            for (uint64_t word : row) put(word, 8);
+        }
+    }
+}
+
+std::vector<uint8_t> Chip8::saveState() const {
+    std::vector<uint8_t> state;
+    saveState(state);
+
+    return state;
+}
+
+void Chip8::loadState(std::span<const uint8_t> state) {
+    if (state.size() != stateSize(settings.mode) || std::memcmp(state.data(), STATE_MAGIC, sizeof(STATE_MAGIC)) != 0) {
+        throw std::runtime_error("Not a savestate");
+    }
+
+    const uint8_t* p = state.data() + sizeof(STATE_MAGIC);
+
+    auto get = [&p](int bytes) {
+        uint64_t value = 0;
+        for (int b = 0; b < bytes; ++b) {
+            value |= uint64_t(*p++) << (8 * b);
+        }
+        return value;
+    };
+
+    auto setKeys = [](std::array<uint8_t, 16>& keys, uint16_t bits) {
+        for (int k = 0; k < 16; ++k) {
+            keys[k] = (bits >> k) & 1;
+        }
+    };
+
+    if (get(2) != STATE_VERSION) {
+        throw std::runtime_error("Unsupported savestate version");
+    }
+
+    // SP follows the magic, version, PC and I.
+    if (state[10] > stack.size()) {
+        throw std::runtime_error("Corrupt savestate");
+    }
+
+    PC = uint16_t(get(2));
+    I = uint16_t(get(2));
+    SP = uint16_t(get(1));
+    for (uint8_t& v : V) v = uint8_t(get(1));
+    for (uint16_t& s : stack) s = uint16_t(get(2));
+    for (uint8_t& r : RPL) r = uint8_t(get(1));
+
+    delayTimer = uint8_t(get(1));
+    soundTimer = uint8_t(get(1));
+    hires = get(1) != 0;
+    halted = get(1) != 0;
+    error = nullptr;
+    setKeys(keypad, uint16_t(get(2)));
+    setKeys(prevKeypad, uint16_t(get(2)));
+    rng = uint32_t(get(4));
+
+    planeMask = uint8_t(get(1));
+    patternLoaded = get(1) != 0;
+    pitch = uint8_t(get(1));
+    for (uint8_t& b : pattern) b = uint8_t(get(1));
+
+    // Only memory that differs is copied and invalidated, so restoring a
+    // nearby state keeps the decode cache and translated code warm.
+    constexpr size_t CHUNK = 64;
+    for (size_t base = 0; base < memory.size(); base += CHUNK) {
+        if (std::memcmp(&memory[base], p + base, CHUNK) != 0) {
+            std::memcpy(&memory[base], p + base, CHUNK);
+            invalidateCache(base, CHUNK);
+        }
+    }
+    p += memory.size();
+
+    for (DisplayBuffer& plane : planes) {
+        for (DisplayRow& row : plane) {
+            for (uint64_t& word : row) word = get(8);
+        }
+    }
+
+    dirtyRows = ALL_ROWS;
+}
+
+void Chip8::dispatch(const CachedOp& op) {
+#ifdef CHIP8_OPCODE_STATS
+    const uint64_t start = OpcodeStats::now();
+    (this->*handlers[op.handler])(op.d);
+    opcodeStats.record(op.handler, OpcodeStats::now() - start);
+#else
+    (this->*handlers[op.handler])(op.d);
+#endif
+}
+
+#ifdef CHIP8_OPCODE_STATS
+const OpcodeStats& Chip8::getOpcodeStats() const {
+    static_assert(HANDLER_COUNT <= OpcodeStats::MAX_HANDLERS);
+
+    return opcodeStats;
+}
+#endif
+
+const char* Chip8::handlerName(size_t handler) {
+    return handler < HANDLER_NAMES.size() ? HANDLER_NAMES[handler] : nullptr;
+}
+
+const char* Chip8::opcodeName(uint16_t op) {
+    return HANDLER_NAMES[DISPATCH_TABLE[dispatchIndex(op)]];
 }
 
-void Chip8::dispatch(const Decoded& d, std::span<const OpEntry> table) {
-    for (const auto& entry : table) {
-        if (entry.match(d.raw)) {
-            auto fn = entry.handler;
-            if (!fn) {
-                std::printf("Null handler for opcode %04X (mask %04X, value %04X)\n",
-                            d.raw, entry.mask, entry.value);
-                return;
+// Cowgod's mnemonics, with the SUPER-CHIP and XO-CHIP extensions named as
+// Octo names them. Opcodes no mode handles come out as data words.
+std::string Chip8::disassemble(uint16_t op) {
+    const Decoded d = decode(op);
+    char text[32];
+
+    if (DISPATCH_TABLE[dispatchIndex(op)] == 0) {
+        std::snprintf(text, sizeof(text), "DW 0x%04X", op);
+        return text;
+    }
+
+    switch (op >> 12) {
+        case 0x0:
+            switch (op & 0xFFF0) {
+                case 0x00C0: std::snprintf(text, sizeof(text), "SCD %u", d.n); return text;
+                case 0x00D0: std::snprintf(text, sizeof(text), "SCU %u", d.n); return text;
             }
-            
-            (this->*fn)(d);
-            return;
+            switch (op) {
+                case 0x00E0: return "CLS";
+                case 0x00EE: return "RET";
+                case 0x00FB: return "SCR";
+                case 0x00FC: return "SCL";
+                case 0x00FD: return "EXIT";
+                case 0x00FE: return "LOW";
+                default:     return "HIGH";
+            }
+        case 0x1: std::snprintf(text, sizeof(text), "JP 0x%03X", d.nnn); break;
+        case 0x2: std::snprintf(text, sizeof(text), "CALL 0x%03X", d.nnn); break;
+        case 0x3: std::snprintf(text, sizeof(text), "SE V%X, 0x%02X", d.x, d.nn); break;
+        case 0x4: std::snprintf(text, sizeof(text), "SNE V%X, 0x%02X", d.x, d.nn); break;
+        case 0x5: {
+            static constexpr const char* NAMES[] = { "SE V%X, V%X", nullptr, "SAVE V%X-V%X", "LOAD V%X-V%X" };
+            std::snprintf(text, sizeof(text), NAMES[d.n], d.x, d.y);
+            break;
         }
+        case 0x6: std::snprintf(text, sizeof(text), "LD V%X, 0x%02X", d.x, d.nn); break;
+        case 0x7: std::snprintf(text, sizeof(text), "ADD V%X, 0x%02X", d.x, d.nn); break;
+        case 0x8: {
+            static constexpr const char* NAMES[16] = { "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                                                       nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL" };
+            std::snprintf(text, sizeof(text), "%s V%X, V%X", NAMES[d.n], d.x, d.y);
+            break;
+        }
+        case 0x9: std::snprintf(text, sizeof(text), "SNE V%X, V%X", d.x, d.y); break;
+        case 0xA: std::snprintf(text, sizeof(text), "LD I, 0x%03X", d.nnn); break;
+        case 0xB: std::snprintf(text, sizeof(text), "JP V0, 0x%03X", d.nnn); break;
+        case 0xC: std::snprintf(text, sizeof(text), "RND V%X, 0x%02X", d.x, d.nn); break;
+        case 0xD: std::snprintf(text, sizeof(text), "DRW V%X, V%X, %u", d.x, d.y, d.n); break;
+        case 0xE: std::snprintf(text, sizeof(text), d.nn == 0x9E ? "SKP V%X" : "SKNP V%X", d.x); break;
+        default:
+            switch (d.nn) {
+                case 0x00: return "LD I, long";
+                case 0x01: std::snprintf(text, sizeof(text), "PLANE %u", d.x); break;
+                case 0x02: return "AUDIO";
+                case 0x07: std::snprintf(text, sizeof(text), "LD V%X, DT", d.x); break;
+                case 0x0A: std::snprintf(text, sizeof(text), "LD V%X, K", d.x); break;
+                case 0x15: std::snprintf(text, sizeof(text), "LD DT, V%X", d.x); break;
+                case 0x18: std::snprintf(text, sizeof(text), "LD ST, V%X", d.x); break;
+                case 0x1E: std::snprintf(text, sizeof(text), "ADD I, V%X", d.x); break;
+                case 0x29: std::snprintf(text, sizeof(text), "LD F, V%X", d.x); break;
+                case 0x30: std::snprintf(text, sizeof(text), "LD HF, V%X", d.x); break;
+                case 0x33: std::snprintf(text, sizeof(text), "LD B, V%X", d.x); break;
+                case 0x3A: std::snprintf(text, sizeof(text), "PITCH V%X", d.x); break;
+                case 0x55: std::snprintf(text, sizeof(text), "LD [I], V%X", d.x); break;
+                case 0x65: std::snprintf(text, sizeof(text), "LD V%X, [I]", d.x); break;
+                case 0x75: std::snprintf(text, sizeof(text), "LD R, V%X", d.x); break;
+                default:   std::snprintf(text, sizeof(text), "LD V%X, R", d.x); break;
+            }
+            break;
+    }
+
+    return text;
+}
+
+void Chip8::startProfiling() {
+    profiler = std::make_unique<Profiler>(memory.size());
+}
+
+const Profiler* Chip8::getProfiler() const {
+    return profiler.get();
+}
+
+// An instruction at addr - 1 also covers addr, so it goes stale too. Writes
+// that run off the end of memory wrap around to the start.
+void Chip8::invalidateCache(size_t addr, size_t len) {
+    if (addr + len > decodeCache.size()) {
+        invalidateCache(0, addr + len - decodeCache.size());
+    }
+
+    const size_t first = addr > 0 ? addr - 1 : 0;
+    const size_t last = std::min(addr + len, decodeCache.size());
+
+    for (size_t i = first; i < last; ++i) {
+        decodeCache[i].valid = false;
+    }
+
+    if (jit) {
+        jit->invalidate(first, last);
+    }
+
+    if (threaded) {
+        threaded->invalidate(first, last);
+    }
+
+    if (aot) {
+        aot->invalidate(first, last);
     }
-    std::printf("Unhandled opcode: %04X\n", d.raw);
 }
 
 void Chip8::cycle() {
-    const uint16_t op = (memory[PC] << 8) | memory[PC + 1];
+    const uint16_t pc = PC & addressMask;
+    CachedOp& entry = decodeCache[pc];
+
+    if (!entry.valid) {
+        const uint16_t op = (memory[pc] << 8) | memory[(pc + 1) & addressMask];
+        entry = CachedOp{decode(op), DISPATCH_TABLE[dispatchIndex(op)], true};
+
+#ifdef CHIP8_OPCODE_STATS
+        constexpr size_t mainEnd = 1 + MAIN_TABLE<CHIP_8_QUIRKS, false>.size();
+        constexpr size_t arithEnd = mainEnd + ARITH_TABLE<CHIP_8_QUIRKS, false>.size();
+
+        const OpcodeStats::Table table = entry.handler == 0 ? OpcodeStats::UNMATCHED
+                                       : entry.handler < mainEnd ? OpcodeStats::MAIN
+                                       : entry.handler < arithEnd ? OpcodeStats::ARITH
+                                       : OpcodeStats::F;
+        opcodeStats.lookups[table]++;
+#endif
+    }
+
     PC += 2;
-    const Decoded d = decode(op);
 
-    dispatch(d, MAIN_TABLE);
+    dispatch(entry);
     prevKeypad = keypad;
 }
 
-void Chip8::op_00E0(const Decoded&) noexcept {
-    for (auto& row : displayBuffer) { 
-        std::fill(row.begin(), row.end(), 0);
+// Idle loops are only looked for every this many instructions, so a ROM
+// spins at most this long before the rest of the wait is skipped.
+static constexpr uint64_t IDLE_CHECK_INTERVAL = 256;
+
+void Chip8::run(uint64_t cycles) {
+    if (profiler) {
+        for (uint64_t i = 0; i < cycles; ++i) {
+            profiler->count(*this);
+            cycle();
+        }
+
+        return;
+    }
+
+    uint64_t executed = 0;
+
+    // Fx0A compares against the keypad as it was before the previous
+    // instruction. Running the first instruction after a keypad change on
+    // the interpreter keeps prevKeypad == keypad for the rest of the run, so
+    // the other backends never need to update it.
+    if (cycles > 0 && prevKeypad != keypad) {
+        cycle();
+        executed++;
     }
 
-    displayBufferUpdated = true;
+    while (executed < cycles) {
+        // Whole iterations of an idle loop leave the machine exactly as they
+        // found it, so they are counted rather than run. Any leftover part
+        // of an iteration still runs, which keeps the end state identical.
+        if (const uint64_t loop = idleLoopLength()) {
+            executed += (cycles - executed) / loop * loop;
+        }
+
+        const uint64_t chunk = std::min(cycles - executed, IDLE_CHECK_INTERVAL);
+        const uint64_t end = executed + chunk;
+
+        if (jit) {
+            while (executed < end) {
+                executed += jit->step(*this, end - executed);
+            }
+        } else if (threaded) {
+            while (executed < end) {
+                executed += threaded->run(*this, end - executed);
+            }
+        } else if (aot) {
+            while (executed < end) {
+                executed += aot->step(*this, end - executed);
+            }
+        } else {
+            for (; executed < end; ++executed) {
+                cycle();
+            }
+        }
+    }
+}
+
+bool Chip8::isIdle() const {
+    return idleLoopLength() > 0;
+}
+
+// Recognizes the usual ways a ROM waits: a jump to itself, Fx0A with no key
+// change to see, and a skip on a key (Ex9E/ExA1) or on the delay timer
+// (Fx07 then 3xkk/4xkk) followed by a jump back. Returns the loop length in
+// instructions if every register it reads is already at its fixed point and
+// the loop will go round again, or 0 if it is not in such a loop.
+uint64_t Chip8::idleLoopLength() const {
+    auto opAt = [this](size_t addr) {
+        addr &= addressMask;
+        return uint16_t(memory[addr] << 8 | memory[(addr + 1) & addressMask]);
+    };
+
+    // Jumps only reach the first 4 KB.
+    auto jumpsTo = [](uint16_t op, uint16_t addr) {
+        return addr <= 0x0FFF && op == (0x1000 | addr);
+    };
+
+    const uint16_t pc = PC & addressMask;
+    const uint16_t op = opAt(pc);
+
+    if (jumpsTo(op, pc)) {
+        return 1;
+    }
+
+    if ((op & 0xF0FF) == 0xF00A && prevKeypad == keypad) {
+        return 1;
+    }
+
+    // The longer loops can be caught at any instruction, so try each start.
+    for (uint16_t back = 0; back <= 4; back += 2) {
+        const uint16_t start = (pc - back) & addressMask;
+        const uint16_t first = opAt(start);
+        const uint8_t x = (first >> 8) & 0x0F;
+
+        if ((first & 0xF0FF) == 0xE09E || (first & 0xF0FF) == 0xE0A1) {
+            if (back > 2 || !jumpsTo(opAt(start + 2), start) || V[x] > 0x0F) {
+                continue;
+            }
+
+            const bool pressed = keypad[V[x] & 0x0F] != 0;
+            if (pressed == ((first & 0xFF) == 0xA1)) {
+                return 2;
+            }
+        }
+
+        if ((first & 0xF0FF) == 0xF007) {
+            const uint16_t skip = opAt(start + 2);
+            const uint8_t kind = skip >> 12;
+            if ((kind != 0x3 && kind != 0x4) || ((skip >> 8) & 0x0F) != x || !jumpsTo(opAt(start + 4), start)) {
+                continue;
+            }
+
+            const bool equal = delayTimer == (skip & 0xFF);
+            if (V[x] == delayTimer && equal == (kind == 0x4)) {
+                return 3;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// A skip steps over the next instruction, which on XO-CHIP may be the
+// four-byte F000 nnnn.
+template <bool Xo>
+void Chip8::skip() noexcept {
+    if constexpr (Xo) {
+        if (memory[PC & addressMask] == 0xF0 && memory[(PC + 1) & addressMask] == 0x00) {
+            PC += 4;
+            return;
+        }
+    }
+
+    PC += 2;
+}
+
+// Halts on the faulting instruction, which runs again, to the same effect,
+// until the host notices. The message is printed once.
+void Chip8::fault(const char* message) noexcept {
+    if (error == nullptr) {
+        std::fprintf(stderr, "%s\n", message);
+    }
+
+    error = message;
+    halted = true;
+    PC -= 2;
+}
+
+void Chip8::op_unhandled(const Decoded& d) noexcept {
+    std::fprintf(stderr, "Unhandled opcode: %04X\n", d.raw);
+}
+
+void Chip8::op_00E0(const Decoded&) noexcept {
+    forSelectedPlanes([](DisplayBuffer& plane) {
+        plane.fill(DisplayRow{});
+    });
+
+    dirtyRows = ALL_ROWS;
 }
 
 void Chip8::op_00EE(const Decoded&) noexcept {
-    if (SP == 0) { 
-        std::printf("Stack underflow\n"); 
-        abort(); 
+    if (SP == 0) {
+        fault("Stack underflow");
+        return;
     }
 
     PC = stack[--SP];
 }
 
-void Chip8::op_00FE(const Decoded& d) noexcept {
-    op_00E0(d);
+// Changing resolution clears every plane, whichever are selected.
+void Chip8::op_00FE(const Decoded&) noexcept {
+    planes = DisplayPlanes{};
     hires = false;
+
+    dirtyRows = ALL_ROWS;
 }
 
-void Chip8::op_00FF(const Decoded& d) noexcept {
-    op_00E0(d);
+void Chip8::op_00FF(const Decoded&) noexcept {
+    planes = DisplayPlanes{};
     hires = true;
+
+    dirtyRows = ALL_ROWS;
 }
 
 void Chip8::op_00CN(const Decoded& d) noexcept {
-    const int width = screenWidth();
-    const int height = screenHeight();
-    int n = std::min<int>(d.n, height);
-    
-    if (n <= 0) {
+    if (d.n == 0) {
         return;
     }
 
-    for (int y = height - 1; y >= 0; --y) {
-        const int src = y - n;
-        for (int x = 0; x < width; ++x) {
-            displayBuffer[y][x] = (src >= 0) ? displayBuffer[src][x] : 0;
-        }
+    forSelectedPlanes([&](DisplayBuffer& plane) {
+        scrollDown(plane, d.n, hires);
+    });
+
+    dirtyRows = ALL_ROWS;
+}
+
+void Chip8::op_00DN(const Decoded& d) noexcept {
+    if (d.n == 0) {
+        return;
     }
 
-    displayBufferUpdated = true;
+    forSelectedPlanes([&](DisplayBuffer& plane) {
+        scrollUp(plane, d.n, hires);
+    });
+
+    dirtyRows = ALL_ROWS;
 }
 
 void Chip8::op_00FB(const Decoded&) noexcept {
-    const int width = screenWidth();
-    const int height = screenHeight();
-    const int s = 4;
-
-    for (int y = 0; y < height; ++y) {
-        for (int x = width - 1; x >= 0; --x) {
-            const int src = x - s;
-            displayBuffer[y][x] = (src >= 0) ? displayBuffer[y][src] : 0;
-        }
-    }
-    displayBufferUpdated = true;
+    forSelectedPlanes([&](DisplayBuffer& plane) {
+        scrollRight(plane, hires);
+    });
+
+    dirtyRows = ALL_ROWS;
 }
 
 void Chip8::op_00FC(const Decoded&) noexcept {
-    const int width = screenWidth();
-    const int height = screenHeight();
-    constexpr int s = 4;
-
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            const int src = x + s;
-            displayBuffer[y][x] = (src < width) ? displayBuffer[y][src] : 0;
-        }
-    }
+    forSelectedPlanes([&](DisplayBuffer& plane) {
+        scrollLeft(plane, hires);
+    });
 
-    displayBufferUpdated = true;
+    dirtyRows = ALL_ROWS;
 }
 
 void Chip8::op_00FD(const Decoded&) noexcept {
@@ -175,30 +663,56 @@ void Chip8::op_1nnn(const Decoded& d) noexcept {
 }
 
 void Chip8::op_2nnn(const Decoded& d) noexcept {
-    if (SP >= 16) { 
-        std::printf("Stack overflow\n"); 
-        abort(); 
+    if (SP >= 16) {
+        fault("Stack overflow");
+        return;
     }
 
     stack[SP++] = PC; 
     PC = d.nnn;
 }
 
+template <bool Xo>
 void Chip8::op_3xkk(const Decoded& d) noexcept {
     if (V[d.x] == d.nn) {
-        PC += 2; 
+        skip<Xo>();
     }
 }
 
+template <bool Xo>
 void Chip8::op_4xkk(const Decoded& d) noexcept {
     if (V[d.x] != d.nn) {
-      PC += 2;   
+        skip<Xo>();
     } 
 }
 
+template <bool Xo>
 void Chip8::op_5xy0(const Decoded& d) noexcept {  
     if (V[d.x] == V[d.y]) {
-        PC += 2;
+        skip<Xo>();
+    }
+}
+
+// Saves Vx to Vy to memory at I, leaving I alone. x may be above y, in
+// which case the registers go out in descending order.
+void Chip8::op_5xy2(const Decoded& d) noexcept {
+    const int step = d.x <= d.y ? 1 : -1;
+    const int count = std::abs(d.y - d.x) + 1;
+
+    for (int i = 0; i < count; ++i) {
+        memory[(I + i) & addressMask] = V[d.x + i * step];
+    }
+
+    invalidateCache(I & addressMask, count);
+}
+
+// Loads Vx to Vy from memory at I, in the same order as 5xy2.
+void Chip8::op_5xy3(const Decoded& d) noexcept {
+    const int step = d.x <= d.y ? 1 : -1;
+    const int count = std::abs(d.y - d.x) + 1;
+
+    for (int i = 0; i < count; ++i) {
+        V[d.x + i * step] = memory[(I + i) & addressMask];
     }
 }
 
@@ -210,13 +724,10 @@ void Chip8::op_7xkk(const Decoded& d) noexcept {
     V[d.x] = uint8_t(V[d.x] + d.nn); 
 }
 
-void Chip8::op_8xy_(const Decoded& d) noexcept {
-    dispatch(d, ARITH_TABLE);
-}
-
+template <bool Xo>
 void Chip8::op_9xy0(const Decoded& d) noexcept {
     if (V[d.x] != V[d.y]) {
-        PC += 2;
+        skip<Xo>();
     }
 }
 
@@ -224,100 +735,82 @@ void Chip8::op_Annn(const Decoded& d) noexcept {
     I = d.nnn; 
 }
 
+template <bool Jump>
 void Chip8::op_Bnnn(const Decoded& d) noexcept {
-    uint8_t x = settings.jump ? d.x : 0;
+    uint8_t x = Jump ? d.x : 0;
     PC = d.nnn + V[x];
 }
 
 void Chip8::op_Cxkk(const Decoded& d) noexcept {  
-    V[d.x] = uint8_t(randByte(rng) & d.nn); 
+    rng = xorshift32(rng);
+    V[d.x] = uint8_t((rng >> 24) & d.nn);
 }
 
+// On XO-CHIP each selected plane is drawn with the next sprite's worth of
+// data from I, and a collision on any of them sets VF.
+template <bool Clipping, bool Xo>
 void Chip8::op_Dxyn(const Decoded& d) noexcept {
-    const int width = screenWidth();
-    const int height = screenHeight();
+    if constexpr (Xo) {
+        const uint16_t spriteBytes = isBigSprite<true>(d.n, hires) ? 32 : d.n;
+        uint16_t addr = I;
+        bool collision = false;
 
-    uint8_t x = V[d.x] % width;
-    uint8_t y = V[d.y] % height;
+        forSelectedPlanes([&](DisplayBuffer& plane) {
+            collision |= drawSprite<Clipping, true>(plane, memory, addr, V[d.x], V[d.y], d.n, hires);
+            addr += spriteBytes;
+        });
 
-    const bool big = (hires && d.n == 0);
-    const int spriteWidth = big ? 16 : 8;
-    const int spriteHeight = big ? 16 : d.n;
-    const int bytesPerRow = (spriteWidth + 7) / 8; // 1 for 8-wide, 2 for 16-wide
+        V[0xF] = collision ? 1 : 0;
 
-    V[0xF] = 0;
-
-    for (int8_t i = 0; i < spriteHeight; i++) {
-        const int memRowBase = I + i * bytesPerRow;
-
-        for (int col = 0; col < spriteWidth; ++col) {
-            const int byteIdx = col >> 3;
-            const int bitIdx  = 7 - (col & 7); 
-            const uint8_t byte = memory[memRowBase + byteIdx];
-            const uint8_t spritePixel = (byte >> bitIdx) & 0x1;
-
-            int xCoord = x + col;
-            int yCoord = y + i;
-
-            if (settings.clipping) {
-                if (xCoord < 0 || yCoord < 0 || xCoord >= width || yCoord >= height) {
-                    continue;
-                }
-            }
-
-            xCoord %= width;
-            yCoord %= height;
-
-            uint8_t& screenPixel = displayBuffer[yCoord][xCoord];
-
-            if (spritePixel == 1 && screenPixel == 1) {
-                V[0xF] = 1;
-            }
-
-            screenPixel ^= spritePixel;
+        if (planeMask != 0) {
+            dirtyRows |= spriteRows<Clipping, true>(V[d.y], d.n, hires);
         }
-    }
+    } else {
+        V[0xF] = drawSprite<Clipping>(planes[0], memory, I, V[d.x], V[d.y], d.n, hires) ? 1 : 0;
 
-    displayBufferUpdated = true;
+        dirtyRows |= spriteRows<Clipping>(V[d.y], d.n, hires);
+    }
 }
 
+// Only the low nibble of Vx names a key.
+template <bool Xo>
 void Chip8::op_Ex9E(const Decoded& d) noexcept {
-    if (keypad[V[d.x]] == 1) {
-        PC += 2;
+    if (keypad[V[d.x] & 0x0F] == 1) {
+        skip<Xo>();
     }
 }
 
+template <bool Xo>
 void Chip8::op_ExA1(const Decoded& d) noexcept {
-    if (keypad[V[d.x]] == 0) {
-        PC += 2;
+    if (keypad[V[d.x] & 0x0F] == 0) {
+        skip<Xo>();
     }
 }
 
-void Chip8::op_Fx__(const Decoded& d) noexcept {
-    dispatch(d, F_TABLE);
-}
-
 void Chip8::op_8xy0(const Decoded& d) noexcept {  
     V[d.x] = V[d.y]; 
 }
 
+template <bool VfReset>
 void Chip8::op_8xy1(const Decoded& d) noexcept {
     V[d.x] = V[d.x] | V[d.y];
-    if (settings.vfReset) {
+    if constexpr (VfReset) {
         V[0xF] = 0;
     }
 }
 
+template <bool VfReset>
 void Chip8::op_8xy2(const Decoded& d) noexcept {
     V[d.x] = V[d.x] & V[d.y];
-    if (settings.vfReset) { 
+    if constexpr (VfReset) { 
         V[0xF] = 0;
     }
 }
 
+template <bool VfReset>
 void Chip8::op_8xy3(const Decoded& d) noexcept {
     V[d.x] = V[d.x] ^ V[d.y];
-    if (settings.vfReset) { 
+    if constexpr (VfReset) { 
         V[0xF] = 0;
     }
 }
@@ -334,8 +827,9 @@ void Chip8::op_8xy5(const Decoded& d) noexcept {
     V[0xF] = (x >= y) ? 1 : 0;
 }
 
+template <bool Shift>
 void Chip8::op_8xy6(const Decoded& d) noexcept {
-    if (!settings.shift) { 
+    if constexpr (!Shift) { 
         V[d.x] = V[d.y];
     }
 
@@ -350,8 +844,9 @@ void Chip8::op_8xy7(const Decoded& d) noexcept {
     V[0xF] = (y >= x) ? 1 : 0;
 }
 
+template <bool Shift>
 void Chip8::op_8xyE(const Decoded& d) noexcept {
-    if (!settings.shift) { 
+    if constexpr (!Shift) { 
         V[d.x] = V[d.y];
     }
     
@@ -368,12 +863,13 @@ void Chip8::op_Fx07(const Decoded& d) noexcept {
     V[d.x] = delayTimer; 
 }
 
+template <bool Press>
 void Chip8::op_Fx0A(const Decoded& d) noexcept {
     bool keyPressed = false;
 
     for (uint8_t i = 0; i < 16; ++i) {
-        if ((!settings.press && (prevKeypad[i] == 1 && keypad[i] == 0))
-         || ( settings.press && (prevKeypad[i] == 0 && keypad[i] == 1))) {
+        if ((!Press && (prevKeypad[i] == 1 && keypad[i] == 0))
+         || ( Press && (prevKeypad[i] == 0 && keypad[i] == 1))) {
             V[d.x] = i; keyPressed = true; break;
         }
     }
@@ -401,27 +897,33 @@ void Chip8::op_Fx30(const Decoded& d) noexcept {
 
 void Chip8::op_Fx33(const Decoded& d) noexcept {
     uint8_t n = V[d.x];
-    memory[I]   = n / 100;
-    memory[I+1] = (n / 10) % 10;
-    memory[I+2] = n % 10;
+    memory[I & addressMask]       = n / 100;
+    memory[(I + 1) & addressMask] = (n / 10) % 10;
+    memory[(I + 2) & addressMask] = n % 10;
+
+    invalidateCache(I & addressMask, 3);
 }
 
+template <bool Memory>
 void Chip8::op_Fx55(const Decoded& d) noexcept {
     for (uint16_t i = 0; i <= d.x; ++i) {
-        memory[I + i] = V[i];
+        memory[(I + i) & addressMask] = V[i];
     }
 
-    if (settings.memory) {
+    invalidateCache(I & addressMask, d.x + 1);
+
+    if constexpr (Memory) {
         I += (d.x + 1);
     }
 }
 
+template <bool Memory>
 void Chip8::op_Fx65(const Decoded& d) noexcept {
     for (uint16_t i = 0; i <= d.x; ++i) {
-        V[i] = memory[I + i];
+        V[i] = memory[(I + i) & addressMask];
     }
     
-    if (settings.memory) {
+    if constexpr (Memory) {
         I += (d.x + 1);
     }
 }
@@ -439,4 +941,62 @@ void Chip8::op_Fx85(const Decoded& d) noexcept {
     for (uint8_t i = 0; i < n; ++i) {
         V[i] = RPL[i];
     }
-}
\ No newline at end of file
+}
+
+// F000 nnnn loads I with the word after it, and is four bytes long.
+void Chip8::op_F000(const Decoded&) noexcept {
+    I = uint16_t(memory[PC & addressMask] << 8 | memory[(PC + 1) & addressMask]);
+    PC += 2;
+}
+
+// Selects the planes to draw on; n is in the x nibble.
+void Chip8::op_Fn01(const Decoded& d) noexcept {
+    planeMask = d.x & ((1 << PLANE_COUNT) - 1);
+}
+
+void Chip8::op_F002(const Decoded&) noexcept {
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        pattern[i] = memory[(I + i) & addressMask];
+    }
+
+    patternLoaded = true;
+}
+
+void Chip8::op_Fx3A(const Decoded& d) noexcept {
+    pitch = V[d.x];
+}
+
+template void Chip8::op_Bnnn<false>(const Decoded&) noexcept;
+template void Chip8::op_Bnnn<true>(const Decoded&) noexcept;
+template void Chip8::op_3xkk<false>(const Decoded&) noexcept;
+template void Chip8::op_3xkk<true>(const Decoded&) noexcept;
+template void Chip8::op_4xkk<false>(const Decoded&) noexcept;
+template void Chip8::op_4xkk<true>(const Decoded&) noexcept;
+template void Chip8::op_5xy0<false>(const Decoded&) noexcept;
+template void Chip8::op_5xy0<true>(const Decoded&) noexcept;
+template void Chip8::op_9xy0<false>(const Decoded&) noexcept;
+template void Chip8::op_9xy0<true>(const Decoded&) noexcept;
+template void Chip8::op_Dxyn<false, false>(const Decoded&) noexcept;
+template void Chip8::op_Dxyn<false, true>(const Decoded&) noexcept;
+template void Chip8::op_Dxyn<true, false>(const Decoded&) noexcept;
+template void Chip8::op_Dxyn<true, true>(const Decoded&) noexcept;
+template void Chip8::op_Ex9E<false>(const Decoded&) noexcept;
+template void Chip8::op_Ex9E<true>(const Decoded&) noexcept;
+template void Chip8::op_ExA1<false>(const Decoded&) noexcept;
+template void Chip8::op_ExA1<true>(const Decoded&) noexcept;
+template void Chip8::op_8xy1<false>(const Decoded&) noexcept;
+template void Chip8::op_8xy1<true>(const Decoded&) noexcept;
+template void Chip8::op_8xy2<false>(const Decoded&) noexcept;
+template void Chip8::op_8xy2<true>(const Decoded&) noexcept;
+template void Chip8::op_8xy3<false>(const Decoded&) noexcept;
+template void Chip8::op_8xy3<true>(const Decoded&) noexcept;
+template void Chip8::op_8xy6<false>(const Decoded&) noexcept;
+template void Chip8::op_8xy6<true>(const Decoded&) noexcept;
+template void Chip8::op_8xyE<false>(const Decoded&) noexcept;
+template void Chip8::op_8xyE<true>(const Decoded&) noexcept;
+template void Chip8::op_Fx0A<false>(const Decoded&) noexcept;
+template void Chip8::op_Fx0A<true>(const Decoded&) noexcept;
+template void Chip8::op_Fx55<false>(const Decoded&) noexcept;
+template void Chip8::op_Fx55<true>(const Decoded&) noexcept;
+template void Chip8::op_Fx65<false>(const Decoded&) noexcept;
+template void Chip8::op_Fx65<true>(const Decoded&) noexcept;
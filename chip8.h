@@ -2,16 +2,54 @@
 
 #include <string>
 #include <array>
-#include <random>
 #include <span>
+#include <memory>
+#include <vector>
 #include <cstdint>
+#include <utility>
 
 #include "settings.h"
+#include "jit.h"
+#include "aot_code.h"
+#include "display_buffer.h"
+#include "sound.h"
+#include "xorshift.h"
+
+#ifdef CHIP8_OPCODE_STATS
+#include "opcode_stats.h"
+#endif
+
+class ThreadedCode;
+class Profiler;
 
 inline constexpr size_t FONT_START = 0x50;
 inline constexpr size_t BIGFONT_START = 0x100;
 inline constexpr size_t ROM_START = 0x200;
-inline constexpr size_t MAX_ROM_SIZE = 4096 - ROM_START;
+
+// CHIP-8 and SUPER-CHIP address 4 KB; XO-CHIP addresses 64 KB.
+constexpr size_t memorySize(Mode mode) {
+    return mode == Mode::XO_CHIP ? 0x10000 : 0x1000;
+}
+
+constexpr size_t maxRomSize(Mode mode) {
+    return memorySize(mode) - ROM_START;
+}
+
+inline constexpr size_t MAX_ROM_SIZE = maxRomSize(Mode::CHIP_8);
+
+// Savestates are a little-endian record whose size depends only on the mode;
+// see Chip8::saveState().
+inline constexpr uint16_t STATE_VERSION = 2;
+
+constexpr size_t stateSize(Mode mode) {
+    return 4 + 2                            // magic, version
+        + 2 + 2 + 1 + 16 + 16 * 2 + 8       // PC, I, SP, V, stack, RPL
+        + 1 + 1 + 1 + 1                     // timers, hires, halted
+        + 2 + 2 + 4                         // keypad, previous keypad, RNG
+        + 1 + 1 + 1 + 16                    // planes, pattern loaded, pitch, pattern
+        + memorySize(mode)                  // memory
+        + PLANE_COUNT * 64 * 2 * 8;         // framebuffer
+}
 
 inline constexpr std::array<uint8_t, 80> FONTSET = {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -87,56 +125,139 @@ inline Decoded decode(uint16_t op) {
     };
 }
 
+// Every handler is selected by the top nibble, the low byte and whether x is
+// zero (only the 00xx opcodes care about x), so 13 bits are enough to index
+// the dispatch table.
+inline constexpr size_t DISPATCH_SIZE = 0x2000;
+
+constexpr uint16_t dispatchIndex(uint16_t op) {
+    return uint16_t(((op & 0xF000) >> 3) | ((op & 0x0F00) ? 0x100 : 0) | (op & 0x00FF));
+}
+
 class Chip8 {
 
     public:
         Chip8(Settings settings);
+        ~Chip8();
         void init();
+        void init(std::span<const uint8_t> rom);
         void tickTimers();
         bool isBeeping() const;
         bool isHires() const;
         int screenWidth() const;
         int screenHeight() const;
         bool isHalted() const;
+        // Why the program halted, if it was a stack overflow or underflow
+        // rather than 00FD. Not part of savestates.
+        const char* getError() const;
         void cycle();
-        const std::array<std::array<uint8_t, 128>, 64>& getDisplayBuffer();
+        void run(uint64_t cycles);
+
+        // True when the program is spinning in a loop that cannot end before
+        // the next timer tick or keypad change, so the host can sleep.
+        bool isIdle() const;
+        // The first plane, which is all of the display outside XO-CHIP.
+        const DisplayBuffer& getDisplayBuffer();
+        const DisplayPlanes& getDisplayPlanes() const;
+        Sound getSound() const;
+
+        // Savestates cover the whole machine except the settings, so they
+        // can only be loaded into an instance set up for the same ROM mode.
+        void saveState(std::vector<uint8_t>& state) const;
+        std::vector<uint8_t> saveState() const;
+        void loadState(std::span<const uint8_t> state);
 
-        bool displayBufferUpdated;
+#ifdef CHIP8_OPCODE_STATS
+        // Counted in dispatch, so only instructions run by the interpreter
+        // show up; the threaded and JIT backends call handlers directly.
+        const OpcodeStats& getOpcodeStats() const;
+#endif
+
+        // The name of a handler index, as in op_<name>.
+        static const char* handlerName(size_t handler);
+        // The name of the handler an opcode dispatches to.
+        static const char* opcodeName(uint16_t op);
+        // An opcode in the usual assembler mnemonics, e.g. "DRW V0, V1, 5".
+        static std::string disassemble(uint16_t op);
+
+        // Counts every instruction from here on by address and call path.
+        // Profiled runs use the interpreter and let idle loops spin, so that
+        // each instruction is counted where it ran.
+        void startProfiling();
+        // Null unless profiling.
+        const Profiler* getProfiler() const;
+
+        // The display rows changed since this was last cleared, bit y for
+        // row y. Whoever draws the display clears it.
+        uint64_t dirtyRows;
         std::array<uint8_t, 16> keypad{};
 
     private:
+        friend class Jit;
+        friend class ThreadedCode;
+        friend class AotCode;
+        friend class Profiler;
+        template <typename Program> friend struct AotBlocks;
+
         using MemHandler = void (Chip8::*)(const Decoded&) noexcept;
         
         struct OpEntry {
             uint16_t mask;
             uint16_t value;
             MemHandler handler;
+            const char* name;
             constexpr bool match(uint16_t op) const { return (op & mask) == value; }
         };
 
+        // A predecoded instruction, keyed by the address it was fetched from.
+        struct CachedOp {
+            Decoded d;
+            uint8_t handler;
+            bool valid;
+        };
+
         uint16_t PC;
         uint16_t I;
         uint16_t SP;
         std::array<uint8_t, 16> V;
         std::array<uint8_t, 8> RPL{};
 
-        std::array<uint8_t, 4096> memory{};
+        // Sized for the mode, so addresses wrap with addressMask.
+        std::vector<uint8_t> memory;
+        std::vector<CachedOp> decodeCache;
+        uint16_t addressMask;
         std::array<uint16_t, 16> stack{};
-        std::array<std::array<uint8_t, 128>, 64> displayBuffer{};
+        DisplayPlanes planes{};
         std::array<uint8_t, 16> prevKeypad{};
         bool hires;
         bool halted;
+        const char* error = nullptr;
+
+        // XO-CHIP: the planes that drawing, clearing and scrolling apply to,
+        // bit p for plane p. Always just the first plane in the other modes.
+        uint8_t planeMask;
 
         uint8_t delayTimer;
         uint8_t soundTimer;
 
-        std::mt19937 rng;
-        std::uniform_int_distribution<uint8_t> randByte;
+        // XO-CHIP's audio pattern buffer and pitch register.
+        std::array<uint8_t, 16> pattern{};
+        bool patternLoaded;
+        uint8_t pitch;
+
+        uint32_t rng;
         Settings settings;
+        const MemHandler* handlers;
+        std::unique_ptr<Jit> jit;
+        std::unique_ptr<ThreadedCode> threaded;
+        std::unique_ptr<AotCode> aot;
+        std::unique_ptr<Profiler> profiler;
 
-        void handleDraw(uint16_t opcode);
-        void handleArithmetic(uint16_t opcode);
+#ifdef CHIP8_OPCODE_STATS
+        OpcodeStats opcodeStats;
+#endif
 
+        void op_unhandled(const Decoded& d) noexcept;
         void op_00E0(const Decoded& d) noexcept;
         void op_00EE(const Decoded& d) noexcept;
         void op_00FE(const Decoded& d) noexcept;
@@ -145,99 +266,198 @@ class Chip8 {
         void op_00FB(const Decoded& d) noexcept;
         void op_00FC(const Decoded& d) noexcept;
         void op_00FD(const Decoded& d) noexcept;
+        void op_00DN(const Decoded& d) noexcept;
         void op_1nnn(const Decoded& d) noexcept;
         void op_2nnn(const Decoded& d) noexcept;
-        void op_3xkk(const Decoded& d) noexcept;
-        void op_4xkk(const Decoded& d) noexcept;
-        void op_5xy0(const Decoded& d) noexcept;
+        template <bool Xo> void op_3xkk(const Decoded& d) noexcept;
+        template <bool Xo> void op_4xkk(const Decoded& d) noexcept;
+        template <bool Xo> void op_5xy0(const Decoded& d) noexcept;
+        void op_5xy2(const Decoded& d) noexcept;
+        void op_5xy3(const Decoded& d) noexcept;
         void op_6xkk(const Decoded& d) noexcept;
         void op_7xkk(const Decoded& d) noexcept;
-        void op_8xy_(const Decoded& d) noexcept;
-        void op_9xy0(const Decoded& d) noexcept;
+        template <bool Xo> void op_9xy0(const Decoded& d) noexcept;
         void op_Annn(const Decoded& d) noexcept;
-        void op_Bnnn(const Decoded& d) noexcept;
+        template <bool Jump> void op_Bnnn(const Decoded& d) noexcept;
         void op_Cxkk(const Decoded& d) noexcept;
-        void op_Dxyn(const Decoded& d) noexcept;
-        void op_Ex9E(const Decoded& d) noexcept;
-        void op_ExA1(const Decoded& d) noexcept;
-        void op_Fx__(const Decoded& d) noexcept;
+        template <bool Clipping, bool Xo> void op_Dxyn(const Decoded& d) noexcept;
+        template <bool Xo> void op_Ex9E(const Decoded& d) noexcept;
+        template <bool Xo> void op_ExA1(const Decoded& d) noexcept;
 
         void op_8xy0(const Decoded& d) noexcept;
-        void op_8xy1(const Decoded& d) noexcept;
-        void op_8xy2(const Decoded& d) noexcept;
-        void op_8xy3(const Decoded& d) noexcept;
+        template <bool VfReset> void op_8xy1(const Decoded& d) noexcept;
+        template <bool VfReset> void op_8xy2(const Decoded& d) noexcept;
+        template <bool VfReset> void op_8xy3(const Decoded& d) noexcept;
         void op_8xy4(const Decoded& d) noexcept;
         void op_8xy5(const Decoded& d) noexcept;
-        void op_8xy6(const Decoded& d) noexcept;
+        template <bool Shift> void op_8xy6(const Decoded& d) noexcept;
         void op_8xy7(const Decoded& d) noexcept;
-        void op_8xyE(const Decoded& d) noexcept;
+        template <bool Shift> void op_8xyE(const Decoded& d) noexcept;
 
         void op_Fx29(const Decoded& d) noexcept;
         void op_Fx07(const Decoded& d) noexcept;
-        void op_Fx0A(const Decoded& d) noexcept;
+        template <bool Press> void op_Fx0A(const Decoded& d) noexcept;
         void op_Fx15(const Decoded& d) noexcept;
         void op_Fx18(const Decoded& d) noexcept;
         void op_Fx1E(const Decoded& d) noexcept;
         void op_Fx30(const Decoded& d) noexcept;
         void op_Fx33(const Decoded& d) noexcept;
-        void op_Fx55(const Decoded& d) noexcept;
-        void op_Fx65(const Decoded& d) noexcept;
+        template <bool Memory> void op_Fx55(const Decoded& d) noexcept;
+        template <bool Memory> void op_Fx65(const Decoded& d) noexcept;
         void op_Fx75(const Decoded& d) noexcept;
         void op_Fx85(const Decoded& d) noexcept;
+        void op_F000(const Decoded& d) noexcept;
+        void op_Fn01(const Decoded& d) noexcept;
+        void op_F002(const Decoded& d) noexcept;
+        void op_Fx3A(const Decoded& d) noexcept;
+
+        void dispatch(const CachedOp& op);
+        void invalidateCache(size_t addr, size_t len);
+        uint64_t idleLoopLength() const;
+        template <bool Xo> void skip() noexcept;
+        void fault(const char* message) noexcept;
+
+        // Runs f on each plane in planeMask.
+        template <typename F>
+        void forSelectedPlanes(F&& f) {
+            for (int p = 0; p < PLANE_COUNT; ++p) {
+                if (planeMask & (1 << p)) {
+                    f(planes[p]);
+                }
+            }
+        }
 
-        void dispatch(const Decoded& d, const std::span<const OpEntry> table);
-
-        inline static constexpr std::array<OpEntry, 24> MAIN_TABLE{{
-            OpEntry{0xFFFF, 0x00E0, &Chip8::op_00E0},
-            OpEntry{0xFFFF, 0x00EE, &Chip8::op_00EE},
-            OpEntry{0xFFFF, 0x00FE, &Chip8::op_00FE},
-            OpEntry{0xFFFF, 0x00FF, &Chip8::op_00FF},
-            OpEntry{0xF0F0, 0x00C0, &Chip8::op_00CN},
-            OpEntry{0xFFFF, 0x00FB, &Chip8::op_00FB},
-            OpEntry{0xFFFF, 0x00FC, &Chip8::op_00FC},
-            OpEntry{0xFFFF, 0x00FD, &Chip8::op_00FD},
-            OpEntry{0xF000, 0x1000, &Chip8::op_1nnn},
-            OpEntry{0xF000, 0x2000, &Chip8::op_2nnn},
-            OpEntry{0xF000, 0x3000, &Chip8::op_3xkk},
-            OpEntry{0xF000, 0x4000, &Chip8::op_4xkk},
-            OpEntry{0xF00F, 0x5000, &Chip8::op_5xy0},
-            OpEntry{0xF000, 0x6000, &Chip8::op_6xkk},
-            OpEntry{0xF000, 0x7000, &Chip8::op_7xkk},
-            OpEntry{0xF000, 0x8000, &Chip8::op_8xy_},
-            OpEntry{0xF00F, 0x9000, &Chip8::op_9xy0},
-            OpEntry{0xF000, 0xA000, &Chip8::op_Annn},
-            OpEntry{0xF000, 0xB000, &Chip8::op_Bnnn},
-            OpEntry{0xF000, 0xC000, &Chip8::op_Cxkk},
-            OpEntry{0xF000, 0xD000, &Chip8::op_Dxyn},
-            OpEntry{0xF0FF, 0xE09E, &Chip8::op_Ex9E},
-            OpEntry{0xF0FF, 0xE0A1, &Chip8::op_ExA1},
-            OpEntry{0xF000, 0xF000, &Chip8::op_Fx__},
+        // The tables are instantiated per quirk profile, so handlers that depend
+        // on a quirk are specialized at compile time instead of testing settings.
+        // They are also instantiated for XO-CHIP, whose skips step over its
+        // four-byte instruction; outside it, its opcodes stay unhandled.
+        template <Quirks Q, bool Xo>
+        inline static constexpr std::array<OpEntry, 25> MAIN_TABLE{{
+            OpEntry{0xFFFF, 0x00E0, &Chip8::op_00E0, "00E0"},
+            OpEntry{0xFFFF, 0x00EE, &Chip8::op_00EE, "00EE"},
+            OpEntry{0xFFFF, 0x00FE, &Chip8::op_00FE, "00FE"},
+            OpEntry{0xFFFF, 0x00FF, &Chip8::op_00FF, "00FF"},
+            OpEntry{0xF0F0, 0x00C0, &Chip8::op_00CN, "00CN"},
+            OpEntry{0xFFFF, 0x00FB, &Chip8::op_00FB, "00FB"},
+            OpEntry{0xFFFF, 0x00FC, &Chip8::op_00FC, "00FC"},
+            OpEntry{0xFFFF, 0x00FD, &Chip8::op_00FD, "00FD"},
+            OpEntry{0xFFF0, 0x00D0, Xo ? &Chip8::op_00DN : &Chip8::op_unhandled, "00DN"},
+            OpEntry{0xF000, 0x1000, &Chip8::op_1nnn, "1nnn"},
+            OpEntry{0xF000, 0x2000, &Chip8::op_2nnn, "2nnn"},
+            OpEntry{0xF000, 0x3000, &Chip8::op_3xkk<Xo>, "3xkk"},
+            OpEntry{0xF000, 0x4000, &Chip8::op_4xkk<Xo>, "4xkk"},
+            OpEntry{0xF00F, 0x5000, &Chip8::op_5xy0<Xo>, "5xy0"},
+            OpEntry{0xF00F, 0x5002, Xo ? &Chip8::op_5xy2 : &Chip8::op_unhandled, "5xy2"},
+            OpEntry{0xF00F, 0x5003, Xo ? &Chip8::op_5xy3 : &Chip8::op_unhandled, "5xy3"},
+            OpEntry{0xF000, 0x6000, &Chip8::op_6xkk, "6xkk"},
+            OpEntry{0xF000, 0x7000, &Chip8::op_7xkk, "7xkk"},
+            OpEntry{0xF00F, 0x9000, &Chip8::op_9xy0<Xo>, "9xy0"},
+            OpEntry{0xF000, 0xA000, &Chip8::op_Annn, "Annn"},
+            OpEntry{0xF000, 0xB000, &Chip8::op_Bnnn<Q.jump>, "Bnnn"},
+            OpEntry{0xF000, 0xC000, &Chip8::op_Cxkk, "Cxkk"},
+            OpEntry{0xF000, 0xD000, &Chip8::op_Dxyn<Q.clipping, Xo>, "Dxyn"},
+            OpEntry{0xF0FF, 0xE09E, &Chip8::op_Ex9E<Xo>, "Ex9E"},
+            OpEntry{0xF0FF, 0xE0A1, &Chip8::op_ExA1<Xo>, "ExA1"},
         }};
 
+        template <Quirks Q, bool Xo>
         inline static constexpr std::array<OpEntry, 9> ARITH_TABLE{{
-            OpEntry{0xF00F, 0x8000, &Chip8::op_8xy0},
-            OpEntry{0xF00F, 0x8001, &Chip8::op_8xy1},
-            OpEntry{0xF00F, 0x8002, &Chip8::op_8xy2},
-            OpEntry{0xF00F, 0x8003, &Chip8::op_8xy3},
-            OpEntry{0xF00F, 0x8004, &Chip8::op_8xy4},
-            OpEntry{0xF00F, 0x8005, &Chip8::op_8xy5},
-            OpEntry{0xF00F, 0x8006, &Chip8::op_8xy6},
-            OpEntry{0xF00F, 0x8007, &Chip8::op_8xy7},
-            OpEntry{0xF00F, 0x800E, &Chip8::op_8xyE},
+            OpEntry{0xF00F, 0x8000, &Chip8::op_8xy0, "8xy0"},
+            OpEntry{0xF00F, 0x8001, &Chip8::op_8xy1<Q.vfReset>, "8xy1"},
+            OpEntry{0xF00F, 0x8002, &Chip8::op_8xy2<Q.vfReset>, "8xy2"},
+            OpEntry{0xF00F, 0x8003, &Chip8::op_8xy3<Q.vfReset>, "8xy3"},
+            OpEntry{0xF00F, 0x8004, &Chip8::op_8xy4, "8xy4"},
+            OpEntry{0xF00F, 0x8005, &Chip8::op_8xy5, "8xy5"},
+            OpEntry{0xF00F, 0x8006, &Chip8::op_8xy6<Q.shift>, "8xy6"},
+            OpEntry{0xF00F, 0x8007, &Chip8::op_8xy7, "8xy7"},
+            OpEntry{0xF00F, 0x800E, &Chip8::op_8xyE<Q.shift>, "8xyE"},
         }};
 
-        inline static constexpr std::array<OpEntry, 12> F_TABLE{{
-            OpEntry{0xF0FF, 0xF029, &Chip8::op_Fx29},
-            OpEntry{0xF0FF, 0xF007, &Chip8::op_Fx07},
-            OpEntry{0xF0FF, 0xF00A, &Chip8::op_Fx0A},
-            OpEntry{0xF0FF, 0xF015, &Chip8::op_Fx15},
-            OpEntry{0xF0FF, 0xF018, &Chip8::op_Fx18},
-            OpEntry{0xF0FF, 0xF01E, &Chip8::op_Fx1E},
-            OpEntry{0xF0FF, 0xF030, &Chip8::op_Fx30},
-            OpEntry{0xF0FF, 0xF033, &Chip8::op_Fx33},
-            OpEntry{0xF0FF, 0xF055, &Chip8::op_Fx55},
-            OpEntry{0xF0FF, 0xF065, &Chip8::op_Fx65},
-            OpEntry{0xF0FF, 0xF075, &Chip8::op_Fx75},
-            OpEntry{0xF0FF, 0xF085, &Chip8::op_Fx85},
+        template <Quirks Q, bool Xo>
+        inline static constexpr std::array<OpEntry, 16> F_TABLE{{
+            OpEntry{0xF0FF, 0xF029, &Chip8::op_Fx29, "Fx29"},
+            OpEntry{0xF0FF, 0xF007, &Chip8::op_Fx07, "Fx07"},
+            OpEntry{0xF0FF, 0xF00A, &Chip8::op_Fx0A<Q.press>, "Fx0A"},
+            OpEntry{0xF0FF, 0xF015, &Chip8::op_Fx15, "Fx15"},
+            OpEntry{0xF0FF, 0xF018, &Chip8::op_Fx18, "Fx18"},
+            OpEntry{0xF0FF, 0xF01E, &Chip8::op_Fx1E, "Fx1E"},
+            OpEntry{0xF0FF, 0xF030, &Chip8::op_Fx30, "Fx30"},
+            OpEntry{0xF0FF, 0xF033, &Chip8::op_Fx33, "Fx33"},
+            OpEntry{0xF0FF, 0xF055, &Chip8::op_Fx55<Q.memory>, "Fx55"},
+            OpEntry{0xF0FF, 0xF065, &Chip8::op_Fx65<Q.memory>, "Fx65"},
+            OpEntry{0xF0FF, 0xF075, &Chip8::op_Fx75, "Fx75"},
+            OpEntry{0xF0FF, 0xF085, &Chip8::op_Fx85, "Fx85"},
+            OpEntry{0xFFFF, 0xF000, Xo ? &Chip8::op_F000 : &Chip8::op_unhandled, "F000"},
+            OpEntry{0xF0FF, 0xF001, Xo ? &Chip8::op_Fn01 : &Chip8::op_unhandled, "Fn01"},
+            OpEntry{0xFFFF, 0xF002, Xo ? &Chip8::op_F002 : &Chip8::op_unhandled, "F002"},
+            OpEntry{0xF0FF, 0xF03A, Xo ? &Chip8::op_Fx3A : &Chip8::op_unhandled, "Fx3A"},
         }};
+
+        // Handler 0 is op_unhandled, followed by MAIN_TABLE, ARITH_TABLE and F_TABLE in order.
+        inline static constexpr size_t HANDLER_COUNT = 1 + MAIN_TABLE<CHIP_8_QUIRKS, false>.size()
+            + ARITH_TABLE<CHIP_8_QUIRKS, false>.size() + F_TABLE<CHIP_8_QUIRKS, false>.size();
+
+        template <Quirks Q, bool Xo>
+        inline static constexpr std::array<MemHandler, HANDLER_COUNT> HANDLERS = [] {
+            std::array<MemHandler, HANDLER_COUNT> handlers{};
+            size_t i = 0;
+
+            handlers[i++] = &Chip8::op_unhandled;
+            for (const auto& entry : MAIN_TABLE<Q, Xo>)  handlers[i++] = entry.handler;
+            for (const auto& entry : ARITH_TABLE<Q, Xo>) handlers[i++] = entry.handler;
+            for (const auto& entry : F_TABLE<Q, Xo>)     handlers[i++] = entry.handler;
+
+            return handlers;
+        }();
+
+        inline static constexpr std::array<const char*, HANDLER_COUNT> HANDLER_NAMES = [] {
+            std::array<const char*, HANDLER_COUNT> names{};
+            size_t i = 0;
+
+            names[i++] = "unhandled";
+            for (const auto& entry : MAIN_TABLE<CHIP_8_QUIRKS, false>)  names[i++] = entry.name;
+            for (const auto& entry : ARITH_TABLE<CHIP_8_QUIRKS, false>) names[i++] = entry.name;
+            for (const auto& entry : F_TABLE<CHIP_8_QUIRKS, false>)     names[i++] = entry.name;
+
+            return names;
+        }();
+
+        // One handler table per quirk combination, indexed by quirkBits().
+        template <bool Xo>
+        inline static constexpr std::array<const MemHandler*, QUIRK_COMBINATIONS> QUIRK_HANDLERS =
+            []<size_t... Bits>(std::index_sequence<Bits...>) {
+                return std::array<const MemHandler*, QUIRK_COMBINATIONS>{
+                    HANDLERS<quirksFromBits(Bits), Xo>.data()...
+                };
+            }(std::make_index_sequence<QUIRK_COMBINATIONS>{});
+
+        // Maps dispatchIndex(op) to an index into HANDLERS. Entries are written in
+        // reverse so the first matching OpEntry wins, as it did with the linear scan.
+        // Masks and values do not depend on quirks or mode, so any profile will do here.
+        inline static constexpr std::array<uint8_t, DISPATCH_SIZE> DISPATCH_TABLE = [] {
+            std::array<uint8_t, DISPATCH_SIZE> table{};
+
+            auto fill = [&table](std::span<const OpEntry> entries, size_t base) {
+                for (size_t e = entries.size(); e-- > 0;) {
+                    const OpEntry& entry = entries[e];
+                    const size_t block = size_t(entry.value >> 12) << 9;
+
+                    for (size_t k = block; k < block + 0x200; ++k) {
+                        const uint16_t op = uint16_t(((k & 0x1E00) << 3) | ((k & 0x100) ? 0x0100 : 0) | (k & 0xFF));
+                        if ((op & entry.mask) == entry.value) {
+                            table[k] = uint8_t(base + e);
+                        }
+                    }
+                }
+            };
+
+            constexpr auto& main = MAIN_TABLE<CHIP_8_QUIRKS, false>;
+            constexpr auto& arith = ARITH_TABLE<CHIP_8_QUIRKS, false>;
+
+            fill(F_TABLE<CHIP_8_QUIRKS, false>, 1 + main.size() + arith.size());
+            fill(arith, 1 + main.size());
+            fill(main, 1);
+
+            return table;
+        }();
 };
\ No newline at end of file
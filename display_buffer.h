@@ -0,0 +1,329 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// The framebuffer is stored as packed bit rows. A row holds 128 pixels in two
+// words; pixel x lives in word x >> 6 at bit 63 - (x & 63), so the leftmost
+// pixel is the most significant bit and sprite bytes can be shifted straight in.
+// Lores only uses the first word of the first 32 rows.
+using DisplayRow = std::array<uint64_t, 2>;
+using DisplayBuffer = std::array<DisplayRow, 64>;
+
+// XO-CHIP draws on two such bit planes, and each pixel's colour comes from
+// the pair of bits. The other modes only ever use the first plane.
+inline constexpr int PLANE_COUNT = 2;
+using DisplayPlanes = std::array<DisplayBuffer, PLANE_COUNT>;
+
+inline bool pixelAt(const DisplayBuffer& buffer, int x, int y) {
+    return (buffer[y][x >> 6] >> (63 - (x & 63))) & 1;
+}
+
+// Shifts a row towards higher x (right on screen) by 0..127 pixels.
+constexpr DisplayRow shiftRowRight(const DisplayRow& row, int s) {
+    if (s == 0) {
+        return row;
+    }
+
+    if (s >= 64) {
+        return DisplayRow{0, row[0] >> (s - 64)};
+    }
+
+    return DisplayRow{row[0] >> s, (row[1] >> s) | (row[0] << (64 - s))};
+}
+
+// Shifts a row towards lower x (left on screen) by 0..127 pixels.
+constexpr DisplayRow shiftRowLeft(const DisplayRow& row, int s) {
+    if (s == 0) {
+        return row;
+    }
+
+    if (s >= 64) {
+        return DisplayRow{row[1] << (s - 64), 0};
+    }
+
+    return DisplayRow{(row[0] << s) | (row[1] >> (64 - s)), row[1] << s};
+}
+
+// The display colours, as RGB, indexed by the planes lit at a pixel: bit 0
+// for the first plane and bit 1 for the second.
+constexpr std::array<std::array<uint8_t, 3>, 4> PALETTE_RGB{{
+    {200, 195, 190},
+    {0, 0, 0},
+    {200, 90, 60},
+    {100, 45, 30},
+}};
+constexpr std::array<uint8_t, 3> BACKGROUND_RGB = PALETTE_RGB[0];
+constexpr std::array<uint8_t, 3> FOREGROUND_RGB = PALETTE_RGB[1];
+
+inline int displayWidth(bool hires) {
+    return hires ? 128 : 64;
+}
+
+inline int displayHeight(bool hires) {
+    return hires ? 64 : 32;
+}
+
+// Changed rows are tracked as a mask with bit y set for row y.
+constexpr uint64_t ALL_ROWS = ~uint64_t(0);
+
+inline uint64_t displayRows(bool hires) {
+    return hires ? ALL_ROWS : 0xFFFFFFFF;
+}
+
+// Whether a sprite with n = 0 is 16x16: in hires, and on XO-CHIP in lores too.
+template <bool Xo>
+bool isBigSprite(uint8_t n, bool hires) {
+    return n == 0 && (Xo || hires);
+}
+
+// The rows drawSprite will touch for the same arguments.
+template <bool Clipping, bool Xo = false>
+uint64_t spriteRows(uint8_t vy, uint8_t n, bool hires) {
+    const int height = displayHeight(hires);
+    const int y = vy % height;
+    const int spriteHeight = isBigSprite<Xo>(n, hires) ? 16 : n;
+
+    if constexpr (Clipping) {
+        const int count = std::min(spriteHeight, height - y);
+        return ((uint64_t(1) << count) - 1) << y;
+    }
+
+    // Rows past the bottom wrap around to the top.
+    const uint64_t rows = (uint64_t(1) << spriteHeight) - 1;
+    if (y == 0) {
+        return rows;
+    }
+
+    return ((rows << y) | (rows >> (height - y))) & displayRows(hires);
+}
+
+// Draws an n-row sprite read from memory at I, with its top left corner at
+// (vx, vy), and returns whether any lit pixel was erased. Addresses wrap at
+// the end of memory, whose size must be a power of two.
+template <bool Clipping, bool Xo = false>
+bool drawSprite(DisplayBuffer& buffer, std::span<const uint8_t> memory,
+                uint16_t I, uint8_t vx, uint8_t vy, uint8_t n, bool hires) {
+    const int width = displayWidth(hires);
+    const int height = displayHeight(hires);
+    const size_t addressMask = memory.size() - 1;
+
+    const int x = vx % width;
+    const int y = vy % height;
+
+    const bool big = isBigSprite<Xo>(n, hires);
+    const int spriteWidth = big ? 16 : 8;
+    const int spriteHeight = big ? 16 : n;
+    const int bytesPerRow = spriteWidth / 8;
+
+    bool collision = false;
+
+    for (int i = 0; i < spriteHeight; i++) {
+        int yCoord = y + i;
+
+        if constexpr (Clipping) {
+            if (yCoord >= height) {
+                break;
+            }
+        }
+
+        yCoord %= height;
+
+        // Line the sprite row up with the left edge of the screen, then shift
+        // it into place. Pixels past the right edge are either dropped or
+        // wrapped around to the left edge.
+        const size_t memRowBase = I + i * bytesPerRow;
+        uint64_t bits = memory[memRowBase & addressMask];
+        if (big) {
+            bits = (bits << 8) | memory[(memRowBase + 1) & addressMask];
+        }
+
+        const DisplayRow sprite{bits << (64 - spriteWidth), 0};
+        DisplayRow mask = shiftRowRight(sprite, x);
+
+        if constexpr (!Clipping) {
+            if (x + spriteWidth > width) {
+                const DisplayRow wrapped = shiftRowLeft(sprite, width - x);
+                mask[0] |= wrapped[0];
+                mask[1] |= wrapped[1];
+            }
+        }
+
+        if (!hires) {
+            mask[1] = 0;
+        }
+
+        DisplayRow& row = buffer[yCoord];
+
+        if ((row[0] & mask[0]) | (row[1] & mask[1])) {
+            collision = true;
+        }
+
+        row[0] ^= mask[0];
+        row[1] ^= mask[1];
+    }
+
+    return collision;
+}
+
+// Scrolls the screen down by n rows.
+inline void scrollDown(DisplayBuffer& buffer, int n, bool hires) {
+    const int height = displayHeight(hires);
+    n = std::min(n, height);
+
+    for (int y = height - 1; y >= 0; --y) {
+        const int src = y - n;
+        buffer[y] = (src >= 0) ? buffer[src] : DisplayRow{};
+    }
+}
+
+// Scrolls the screen up by n rows (XO-CHIP).
+inline void scrollUp(DisplayBuffer& buffer, int n, bool hires) {
+    const int height = displayHeight(hires);
+    n = std::min(n, height);
+
+    for (int y = 0; y < height; ++y) {
+        const int src = y + n;
+        buffer[y] = (src < height) ? buffer[src] : DisplayRow{};
+    }
+}
+
+// Scrolls the screen right by 4 pixels.
+inline void scrollRight(DisplayBuffer& buffer, bool hires) {
+    const int height = displayHeight(hires);
+
+    for (int y = 0; y < height; ++y) {
+        DisplayRow& row = buffer[y];
+        row = shiftRowRight(row, 4);
+
+        // In lores the pixels pushed past x = 63 fall off the screen.
+        if (!hires) {
+            row[1] = 0;
+        }
+    }
+}
+
+// Scrolls the screen left by 4 pixels.
+inline void scrollLeft(DisplayBuffer& buffer, bool hires) {
+    const int height = displayHeight(hires);
+
+    for (int y = 0; y < height; ++y) {
+        buffer[y] = shiftRowLeft(buffer[y], 4);
+    }
+}
+
+// Expands rows [firstRow, lastRow] of the left width pixels to one 32-bit
+// colour each, with rows pitch bytes apart from the start of pixels. Each
+// pixel takes the palette entry its two plane bits index. This is the CPU
+// side of Window::draw.
+//
+// Pixels go four at a time with SSE2 or NEON: a nibble of a plane's row is
+// broadcast to all four lanes and tested against each lane's bit, giving a
+// mask per plane. Words with nothing on the second plane, which is all of
+// them outside XO-CHIP, only need the first mask to select between two
+// colours. Elsewhere the colour is built up from the background by XORing
+// in the difference each mask (and both together) makes.
+inline void expandPixels(const DisplayPlanes& planes, int width, int firstRow, int lastRow,
+                         const std::array<uint32_t, 4>& palette, void* pixels, int pitch) {
+    uint8_t* row = static_cast<uint8_t*>(pixels);
+
+    const uint32_t first = palette[0] ^ palette[1];
+    const uint32_t second = palette[0] ^ palette[2];
+    const uint32_t both = first ^ second ^ palette[0] ^ palette[3];
+
+#if defined(__SSE2__)
+    const __m128i bg = _mm_set1_epi32(int(palette[0]));
+    const __m128i fg = _mm_set1_epi32(int(palette[1]));
+    const __m128i firsts = _mm_set1_epi32(int(first));
+    const __m128i seconds = _mm_set1_epi32(int(second));
+    const __m128i boths = _mm_set1_epi32(int(both));
+    const __m128i lanes = _mm_set_epi32(1, 2, 4, 8);
+#elif defined(__ARM_NEON)
+    const uint32x4_t bg = vdupq_n_u32(palette[0]);
+    const uint32x4_t fg = vdupq_n_u32(palette[1]);
+    const uint32x4_t firsts = vdupq_n_u32(first);
+    const uint32x4_t seconds = vdupq_n_u32(second);
+    const uint32x4_t boths = vdupq_n_u32(both);
+    static const uint32_t LANE_BITS[4] = {8, 4, 2, 1};
+    const uint32x4_t lanes = vld1q_u32(LANE_BITS);
+#endif
+
+    for (int y = firstRow; y <= lastRow; ++y) {
+        uint32_t* px = reinterpret_cast<uint32_t*>(row);
+
+        for (int x = 0; x < width; x += 64) {
+            const uint64_t bits0 = planes[0][y][x >> 6];
+            const uint64_t bits1 = planes[1][y][x >> 6];
+            const int count = std::min(64, width - x);
+            int i = 0;
+
+#if defined(__SSE2__)
+            if (bits1 == 0) {
+                for (; i + 4 <= count; i += 4) {
+                    const __m128i nibble = _mm_set1_epi32(int((bits0 >> (60 - i)) & 0xF));
+                    const __m128i lit = _mm_cmpeq_epi32(_mm_and_si128(nibble, lanes), lanes);
+                    const __m128i colour = _mm_or_si128(_mm_and_si128(lit, fg), _mm_andnot_si128(lit, bg));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(px + x + i), colour);
+                }
+            } else {
+                for (; i + 4 <= count; i += 4) {
+                    const __m128i nibble0 = _mm_set1_epi32(int((bits0 >> (60 - i)) & 0xF));
+                    const __m128i nibble1 = _mm_set1_epi32(int((bits1 >> (60 - i)) & 0xF));
+                    const __m128i lit0 = _mm_cmpeq_epi32(_mm_and_si128(nibble0, lanes), lanes);
+                    const __m128i lit1 = _mm_cmpeq_epi32(_mm_and_si128(nibble1, lanes), lanes);
+                    __m128i colour = _mm_xor_si128(bg, _mm_and_si128(lit0, firsts));
+                    colour = _mm_xor_si128(colour, _mm_and_si128(lit1, seconds));
+                    colour = _mm_xor_si128(colour, _mm_and_si128(_mm_and_si128(lit0, lit1), boths));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(px + x + i), colour);
+                }
+            }
+#elif defined(__ARM_NEON)
+            if (bits1 == 0) {
+                for (; i + 4 <= count; i += 4) {
+                    const uint32x4_t nibble = vdupq_n_u32(uint32_t(bits0 >> (60 - i)) & 0xF);
+                    vst1q_u32(px + x + i, vbslq_u32(vtstq_u32(nibble, lanes), fg, bg));
+                }
+            } else {
+                for (; i + 4 <= count; i += 4) {
+                    const uint32x4_t lit0 = vtstq_u32(vdupq_n_u32(uint32_t(bits0 >> (60 - i)) & 0xF), lanes);
+                    const uint32x4_t lit1 = vtstq_u32(vdupq_n_u32(uint32_t(bits1 >> (60 - i)) & 0xF), lanes);
+                    uint32x4_t colour = veorq_u32(bg, vandq_u32(lit0, firsts));
+                    colour = veorq_u32(colour, vandq_u32(lit1, seconds));
+                    colour = veorq_u32(colour, vandq_u32(vandq_u32(lit0, lit1), boths));
+                    vst1q_u32(px + x + i, colour);
+                }
+            }
+#endif
+
+            for (; i < count; ++i) {
+                const uint32_t lit0 = 0 - uint32_t((bits0 >> (63 - i)) & 1);
+                const uint32_t lit1 = 0 - uint32_t((bits1 >> (63 - i)) & 1);
+                px[x + i] = palette[0] ^ (lit0 & first) ^ (lit1 & second) ^ (lit0 & lit1 & both);
+            }
+        }
+
+        row += pitch;
+    }
+}
+
+// Every pixel lit on any plane, for displays that only have one colour.
+inline DisplayBuffer mergePlanes(const DisplayPlanes& planes) {
+    DisplayBuffer merged = planes[0];
+
+    for (int p = 1; p < PLANE_COUNT; ++p) {
+        for (size_t y = 0; y < merged.size(); ++y) {
+            merged[y][0] |= planes[p][y][0];
+            merged[y][1] |= planes[p][y][1];
+        }
+    }
+
+    return merged;
+}
@@ -0,0 +1,333 @@
+#include "emulator.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+static constexpr double TIMER_TICK_DURATION = 1.0 / 60.0;
+static constexpr double FRAME_DURATION = 1.0 / 60.0;
+static constexpr double SPEED_WINDOW = 0.5;
+static constexpr size_t HOT_LIST_LENGTH = 20;
+
+static uint16_t keypadBits(const std::array<uint8_t, 16>& keypad) {
+    uint16_t bits = 0;
+    for (int key = 0; key < 16; ++key) {
+        bits |= uint16_t(keypad[key] != 0) << key;
+    }
+
+    return bits;
+}
+
+static void setKeypadBits(std::array<uint8_t, 16>& keypad, uint16_t bits) {
+    for (int key = 0; key < 16; ++key) {
+        keypad[key] = (bits >> key) & 1;
+    }
+}
+
+// Runs up to the target cycle, applying the movie's keypad changes and timer
+// ticks at exactly the cycles they were recorded at. Returns the number of
+// timer ticks.
+static int replay(Chip8& chip8, InputMovie& movie, uint64_t& cycle, uint64_t target) {
+    int ticks = 0;
+
+    while (!movie.finished() && movie.next().cycle <= target) {
+        const InputMovie::Event& event = movie.next();
+        chip8.run(event.cycle - cycle);
+        cycle = event.cycle;
+
+        if (event.keys) {
+            setKeypadBits(chip8.keypad, event.keypad);
+        } else {
+            chip8.tickTimers();
+            ticks++;
+        }
+
+        movie.advance();
+    }
+
+    chip8.run(target - cycle);
+    cycle = target;
+
+    return ticks;
+}
+
+// A movie fixes the seed, so a recording always has one to store.
+static std::unique_ptr<InputMovie> openMovie(Settings& settings, const std::string& recordPath, const std::string& replayPath) {
+    if (!replayPath.empty()) {
+        auto movie = std::make_unique<InputMovie>(replayPath);
+        settings.seed = movie->getSeed();
+
+        return movie;
+    }
+
+    if (!recordPath.empty()) {
+        if (!settings.seed) {
+            settings.seed = std::random_device{}();
+        }
+
+        return std::make_unique<InputMovie>(*settings.seed);
+    }
+
+    return nullptr;
+}
+
+Emulator::Emulator(Settings s, const std::string& recordPath, const std::string& replayPath,
+                   const std::string& profilePath)
+    : settings(s),
+      movie(openMovie(settings, recordPath, replayPath)),
+      chip8(settings),
+      recordPath(recordPath),
+      profilePath(profilePath) {
+    chip8.init();
+
+    if (!profilePath.empty()) {
+        chip8.startProfiling();
+    }
+    rewind.capture(chip8);
+
+    replaying = !replayPath.empty();
+    recording = !replaying && movie;
+
+    publish();
+}
+
+Emulator::~Emulator() {
+    stop();
+}
+
+void Emulator::setTimerListener(std::function<void(const Sound& sound)> listener) {
+    timerListener = std::move(listener);
+}
+
+void Emulator::start() {
+    started = true;
+    running = true;
+    thread = std::thread(&Emulator::loop, this);
+}
+
+void Emulator::stop() {
+    running = false;
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    // A run that never started has nothing worth saving.
+    if (recording && started) {
+        recording = false;
+
+        try {
+            movie->save(recordPath);
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "%s\n", e.what());
+        }
+    }
+
+    if (!profilePath.empty() && started) {
+        const Profiler& profiler = *chip8.getProfiler();
+
+        if (std::FILE* out = std::fopen(profilePath.c_str(), "w")) {
+            profiler.writeStacks(out);
+            std::fclose(out);
+        } else {
+            std::fprintf(stderr, "Unable to write %s\n", profilePath.c_str());
+        }
+
+        // On stderr, as --dump-video=- may be writing video to stdout.
+        profiler.writeHotList(stderr, HOT_LIST_LENGTH);
+        profilePath.clear();
+    }
+}
+
+void Emulator::step() {
+    started = true;
+
+    readKeypad();
+    advance(FRAME_DURATION, false, true);
+    publish();
+}
+
+void Emulator::setKeypad(uint16_t keys) {
+    keypad.store(keys, std::memory_order_relaxed);
+}
+
+void Emulator::setRewinding(bool rewinding) {
+    rewindHeld.store(rewinding, std::memory_order_relaxed);
+}
+
+void Emulator::setTurbo(bool turbo) {
+    turboHeld.store(turbo, std::memory_order_relaxed);
+}
+
+void Emulator::requestOpcodeStats() {
+    opcodeStatsRequested.store(true, std::memory_order_relaxed);
+}
+
+TripleBuffer<Emulator::Frame>& Emulator::frames() {
+    return frameBuffer;
+}
+
+FramePacer::Stats Emulator::pacingStats() const {
+    return pacing;
+}
+
+// The same per-frame schedule the main loop used to run: input, the CPU
+// cycles and timer ticks the elapsed time calls for, then a frame out.
+//
+// In turbo the core runs whole emulated frames back to back, as many as fit
+// in one real frame, and only then hands a frame over. The display and
+// audio stay at 60 Hz, so drawing never holds the core back.
+void Emulator::loop() {
+    using Clock = std::chrono::steady_clock;
+
+    FramePacer pacer(FRAME_DURATION);
+    Clock::time_point previousTime = Clock::now();
+    Clock::time_point speedStart = previousTime;
+    double emulatedTime = 0;
+
+    while (running.load(std::memory_order_relaxed) && !chip8.isHalted()) {
+        const Clock::time_point now = Clock::now();
+        const double delta = std::clamp(std::chrono::duration<double>(now - previousTime).count(), 0.0, 0.25);
+
+        readKeypad();
+
+        // Movies need an unbroken run, so there is no rewind then.
+        const bool rewinding = !movie && rewindHeld.load(std::memory_order_relaxed);
+        const bool turbo = !rewinding && turboHeld.load(std::memory_order_relaxed);
+
+        if (turbo) {
+            const Clock::time_point frameEnd = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(FRAME_DURATION));
+            do {
+                advance(FRAME_DURATION, false, false);
+                emulatedTime += FRAME_DURATION;
+            } while (Clock::now() < frameEnd && !chip8.isHalted());
+
+            if (timerListener) {
+                timerListener(chip8.getSound());
+            }
+        } else {
+            advance(delta * settings.speed, rewinding, true);
+            emulatedTime += delta * settings.speed;
+        }
+
+        previousTime = turbo ? Clock::now() : now;
+
+#ifdef CHIP8_OPCODE_STATS
+        if (opcodeStatsRequested.exchange(false, std::memory_order_relaxed)) {
+            chip8.getOpcodeStats().write(stderr);
+        }
+#endif
+
+        // The multiplier is averaged over half a second, as single frames
+        // are too noisy to read.
+        const double wall = std::chrono::duration<double>(previousTime - speedStart).count();
+        if (wall >= SPEED_WINDOW) {
+            speed = emulatedTime / wall;
+            emulatedTime = 0;
+            speedStart = previousTime;
+        }
+
+        pacing = pacer.stats();
+        publish();
+
+        // Turbo frames already took a frame's time to run.
+        if (!turbo) {
+            pacer.wait();
+        }
+    }
+
+#ifdef CHIP8_OPCODE_STATS
+    chip8.getOpcodeStats().write(stderr);
+#endif
+
+    pacing = pacer.stats();
+    publish();
+}
+
+// While a movie plays back, it supplies the keypad instead.
+void Emulator::readKeypad() {
+    if (replaying) {
+        return;
+    }
+
+    setKeypadBits(chip8.keypad, keypad.load(std::memory_order_relaxed));
+
+    if (recording) {
+        movie->recordKeys(cycleCount, keypadBits(chip8.keypad));
+    }
+}
+
+// Runs the CPU cycles and timer ticks for the given amount of emulated time,
+// or steps back through the rewind buffer a frame per timer tick. audible
+// passes each tick on to the timer listener.
+void Emulator::advance(double seconds, bool rewinding, bool audible) {
+    const double cpuTick = 1.0 / settings.cyclesPerSecond;
+
+    cpuAccumulator += seconds;
+    timerAccumulator += seconds;
+
+    if (rewinding) {
+        cpuAccumulator = 0;
+    } else if (cpuAccumulator >= cpuTick) {
+        const uint64_t cycles = uint64_t(cpuAccumulator / cpuTick);
+        if (replaying) {
+            const int ticks = replay(chip8, *movie, cycleCount, cycleCount + cycles);
+
+            for (int i = 0; audible && timerListener && i < ticks; ++i) {
+                timerListener(chip8.getSound());
+            }
+        } else {
+            chip8.run(cycles);
+            cycleCount += cycles;
+        }
+        cpuAccumulator -= cycles * cpuTick;
+    }
+
+    // The movie's own timer ticks stand in for the clock's. Once it runs
+    // out, the keyboard and the clock take over.
+    if (replaying) {
+        replaying = !movie->finished();
+        timerAccumulator = 0;
+    }
+
+    while (timerAccumulator >= TIMER_TICK_DURATION) {
+        if (rewinding) {
+            rewind.step(chip8);
+        } else {
+            chip8.tickTimers();
+            rewind.capture(chip8);
+
+            if (recording) {
+                movie->recordFrame(cycleCount);
+            }
+        }
+
+        if (audible && timerListener) {
+            timerListener(chip8.getSound());
+        }
+
+        timerAccumulator -= TIMER_TICK_DURATION;
+    }
+}
+
+void Emulator::publish() {
+    Frame& frame = frameBuffer.back();
+
+    frame.display = chip8.getDisplayPlanes();
+    frame.sequence = ++sequence;
+    frame.dirtyRows = chip8.dirtyRows;
+    chip8.dirtyRows = 0;
+    frame.hires = chip8.isHires();
+    frame.sound = chip8.getSound();
+    frame.halted = chip8.isHalted();
+    frame.rewindFrames = rewind.frames();
+    frame.rewindFrameBytes = rewind.averageFrameBytes();
+    frame.rewindBytes = rewind.bytesUsed();
+    frame.rewindCapacity = rewind.capacity();
+    frame.pacing = pacing;
+    frame.speed = speed;
+
+    frameBuffer.publish();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "chip8.h"
+#include "rewind.h"
+#include "input_movie.h"
+#include "frame_pacer.h"
+#include "triple_buffer.h"
+
+// Runs a Chip8 on its own thread, paced to real time, so a stalled present,
+// a dragged window or a slow event queue on the render thread never costs it
+// any cycles. Frames come out through a triple buffer and input goes in
+// through atomics; nothing else is shared between the threads.
+class Emulator {
+
+    public:
+        // What the render thread needs from one emulated frame.
+        struct Frame {
+            DisplayPlanes display;
+            // Numbered in order, so the reader can tell when it missed
+            // frames and their dirty rows with them.
+            uint64_t sequence;
+            // The display rows changed since the previous frame.
+            uint64_t dirtyRows;
+            bool hires;
+            Sound sound;
+            bool halted;
+
+            size_t rewindFrames;
+            double rewindFrameBytes;
+            size_t rewindBytes;
+            size_t rewindCapacity;
+            FramePacer::Stats pacing;
+            // Emulated seconds per real second, lately.
+            double speed;
+        };
+
+        // Movies are loaded or started here, so the seed is known before the
+        // core is created. Throws std::runtime_error if the ROM or movie
+        // cannot be loaded. A profile path turns on the guest profiler.
+        Emulator(Settings settings, const std::string& recordPath, const std::string& replayPath,
+                 const std::string& profilePath);
+        ~Emulator();
+
+        // Called on the emulation thread with the sound after every timer
+        // tick, or once per shown frame in turbo. Set it before start().
+        void setTimerListener(std::function<void(const Sound& sound)> listener);
+
+        void start();
+        // Stops the thread and writes the movie being recorded, if any. When
+        // profiling, writes the call stacks to the profile and prints the
+        // hottest addresses.
+        void stop();
+
+        // Runs one emulated frame on the calling thread and publishes it,
+        // for headless runs. Not for use alongside start().
+        void step();
+
+        // Called from the render thread.
+        void setKeypad(uint16_t keys);
+        void setRewinding(bool rewinding);
+        // Runs the core as fast as it will go while set.
+        void setTurbo(bool turbo);
+        void requestOpcodeStats();
+        TripleBuffer<Frame>& frames();
+
+        // The emulation thread's pacing; only read this once stopped.
+        FramePacer::Stats pacingStats() const;
+
+    private:
+        Settings settings;
+        std::unique_ptr<InputMovie> movie;
+        Chip8 chip8;
+        Rewind rewind;
+        std::string recordPath;
+        bool recording = false;
+        bool replaying = false;
+        std::string profilePath;
+        bool started = false;
+        FramePacer::Stats pacing{};
+        uint64_t sequence = 0;
+        double speed = 1.0;
+
+        double cpuAccumulator = 0;
+        double timerAccumulator = 0;
+        uint64_t cycleCount = 0;
+        std::function<void(const Sound&)> timerListener;
+
+        std::thread thread;
+        std::atomic<bool> running{false};
+        std::atomic<uint16_t> keypad{0};
+        std::atomic<bool> rewindHeld{false};
+        std::atomic<bool> turboHeld{false};
+        std::atomic<bool> opcodeStatsRequested{false};
+        TripleBuffer<Frame> frameBuffer;
+
+        void loop();
+        void readKeypad();
+        void advance(double seconds, bool rewinding, bool audible);
+        void publish();
+};
@@ -0,0 +1,72 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+FramePacer::FramePacer(double frameSeconds)
+    : frame(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(frameSeconds))) {
+    deadline = Clock::now() + frame;
+    previousFrame = Clock::now();
+    resetStats();
+}
+
+void FramePacer::wait() {
+    Clock::time_point now = Clock::now();
+
+    if (deadline - now > margin) {
+        const Clock::time_point wake = deadline - margin;
+        std::this_thread::sleep_until(wake);
+
+        // Widen the margin at once when a sleep overshoots it, and narrow
+        // it slowly while sleeps are waking on time.
+        const Clock::duration late = Clock::now() - wake;
+        if (late > margin) {
+            margin = std::min<Clock::duration>(late + late / 2, MAX_MARGIN);
+        } else {
+            margin = std::max<Clock::duration>(margin - margin / 16, MIN_MARGIN);
+        }
+    }
+
+    while ((now = Clock::now()) < deadline) {
+        std::this_thread::yield();
+    }
+
+    // More than a frame behind means a stall, not jitter; start over.
+    if (now - deadline > frame) {
+        deadline = now;
+    }
+    deadline += frame;
+
+    const double interval = std::chrono::duration<double, std::milli>(now - previousFrame).count();
+    previousFrame = now;
+
+    frames++;
+    sum += interval;
+    sumSquares += interval * interval;
+    longest = std::max(longest, interval);
+}
+
+FramePacer::Stats FramePacer::stats() const {
+    const double wall = std::chrono::duration<double>(Clock::now() - statsStart).count();
+    const double cpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    const double mean = frames > 0 ? sum / frames : 0;
+    const double variance = frames > 0 ? std::max(sumSquares / frames - mean * mean, 0.0) : 0;
+
+    return Stats {
+        frames,
+        mean,
+        std::sqrt(variance),
+        longest,
+        wall > 0 ? 100.0 * cpu / wall : 0,
+    };
+}
+
+void FramePacer::resetStats() {
+    statsStart = Clock::now();
+    cpuStart = std::clock();
+    frames = 0;
+    sum = 0;
+    sumSquares = 0;
+    longest = 0;
+}
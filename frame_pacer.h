@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+// Paces the main loop to a fixed frame rate. wait() sleeps until the next
+// frame deadline: the OS sleep covers all but a small margin, which is spun
+// out, since sleeps routinely overshoot. The margin follows how late sleeps
+// have actually been waking on this host, so the spin stays as short as
+// the scheduler allows. If a frame runs long (or a vsynced present already
+// blocked past the deadline) the next one starts straight away, and after
+// a real stall the schedule restarts rather than trying to catch up.
+//
+// It also keeps the numbers needed to judge the pacing: the mean and
+// standard deviation (jitter) of frame intervals, the worst interval, and
+// how much host CPU time the process used per wall-clock second.
+class FramePacer {
+
+    public:
+        struct Stats {
+            uint64_t frames;
+            double meanMs;
+            double jitterMs;
+            double maxMs;
+            double cpuPercent;
+        };
+
+        explicit FramePacer(double frameSeconds);
+
+        void wait();
+
+        Stats stats() const;
+        void resetStats();
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        // Bounds on how much of each wait is spun rather than slept.
+        static constexpr std::chrono::microseconds MIN_MARGIN{100};
+        static constexpr std::chrono::microseconds MAX_MARGIN{4000};
+
+        Clock::duration frame;
+        Clock::duration margin = std::chrono::microseconds(1000);
+        Clock::time_point deadline;
+        Clock::time_point previousFrame;
+
+        Clock::time_point statsStart;
+        std::clock_t cpuStart;
+        uint64_t frames = 0;
+        double sum = 0;
+        double sumSquares = 0;
+        double longest = 0;
+};
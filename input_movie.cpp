@@ -0,0 +1,139 @@
+#include "input_movie.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+static constexpr char MOVIE_MAGIC[4] = {'C', '8', 'M', 'V'};
+static constexpr uint16_t MOVIE_VERSION = 1;
+static constexpr size_t HEADER_SIZE = 4 + 2 + 4;
+
+static void putVarint(std::ofstream& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.put(char(uint8_t(value | 0x80)));
+        value >>= 7;
+    }
+
+    out.put(char(uint8_t(value)));
+}
+
+static uint64_t getVarint(const std::vector<uint8_t>& data, size_t& pos) {
+    uint64_t value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= data.size()) {
+            throw std::runtime_error("Truncated input movie");
+        }
+
+        const uint8_t byte = data[pos++];
+        value |= uint64_t(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+
+    throw std::runtime_error("Corrupt input movie");
+}
+
+InputMovie::InputMovie(uint32_t seed) : seed(seed) {
+}
+
+InputMovie::InputMovie(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Unable to open input movie");
+    }
+
+    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    if (data.size() < HEADER_SIZE || !std::equal(std::begin(MOVIE_MAGIC), std::end(MOVIE_MAGIC), data.begin())) {
+        throw std::runtime_error("Not an input movie");
+    }
+
+    if ((data[4] | data[5] << 8) != MOVIE_VERSION) {
+        throw std::runtime_error("Unsupported input movie version");
+    }
+
+    seed = uint32_t(data[6]) | uint32_t(data[7]) << 8 | uint32_t(data[8]) << 16 | uint32_t(data[9]) << 24;
+
+    size_t pos = HEADER_SIZE;
+    uint64_t cycle = 0;
+
+    while (pos < data.size()) {
+        const uint64_t word = getVarint(data, pos);
+        cycle += word >> 1;
+
+        Event event { cycle, bool(word & 1), 0 };
+        if (event.keys) {
+            if (pos + 2 > data.size()) {
+                throw std::runtime_error("Truncated input movie");
+            }
+
+            event.keypad = uint16_t(data[pos] | data[pos + 1] << 8);
+            pos += 2;
+        }
+
+        events.push_back(event);
+    }
+}
+
+void InputMovie::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Unable to create input movie");
+    }
+
+    out.write(MOVIE_MAGIC, sizeof(MOVIE_MAGIC));
+    out.put(char(MOVIE_VERSION & 0xFF));
+    out.put(char(MOVIE_VERSION >> 8));
+    for (int b = 0; b < 4; ++b) {
+        out.put(char(uint8_t(seed >> (8 * b))));
+    }
+
+    uint64_t cycle = 0;
+    for (const Event& event : events) {
+        putVarint(out, (event.cycle - cycle) << 1 | uint64_t(event.keys));
+        cycle = event.cycle;
+
+        if (event.keys) {
+            out.put(char(event.keypad & 0xFF));
+            out.put(char(event.keypad >> 8));
+        }
+    }
+
+    if (!out) {
+        throw std::runtime_error("Unable to write input movie");
+    }
+}
+
+uint32_t InputMovie::getSeed() const {
+    return seed;
+}
+
+// Only changes are kept, so a held key costs nothing until it is released.
+void InputMovie::recordKeys(uint64_t cycle, uint16_t keypad) {
+    if (keypad == lastKeypad) {
+        return;
+    }
+
+    events.push_back(Event { cycle, true, keypad });
+    lastKeypad = keypad;
+}
+
+void InputMovie::recordFrame(uint64_t cycle) {
+    events.push_back(Event { cycle, false, 0 });
+}
+
+bool InputMovie::finished() const {
+    return position >= events.size();
+}
+
+const InputMovie::Event& InputMovie::next() const {
+    return events[position];
+}
+
+void InputMovie::advance() {
+    position++;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A recording of everything outside the CPU that affects a run: the RNG
+// seed, every keypad change and every timer tick, each stamped with the
+// number of instructions executed before it. Replaying one with the same
+// settings repeats the run instruction for instruction.
+//
+// On disk it is "C8MV", a version and the seed, followed by one varint per
+// event holding (cycles since the previous event << 1 | is a keypad change)
+// and, for keypad changes, the 16 key bits.
+class InputMovie {
+
+    public:
+        struct Event {
+            uint64_t cycle;
+            bool keys;
+            uint16_t keypad;
+        };
+
+        explicit InputMovie(uint32_t seed);
+        explicit InputMovie(const std::string& path);
+
+        void save(const std::string& path) const;
+
+        uint32_t getSeed() const;
+
+        void recordKeys(uint64_t cycle, uint16_t keypad);
+        void recordFrame(uint64_t cycle);
+
+        // Playback walks the events in order.
+        bool finished() const;
+        const Event& next() const;
+        void advance();
+
+    private:
+        uint32_t seed;
+        std::vector<Event> events;
+        size_t position = 0;
+        uint16_t lastKeypad = 0;
+};
@@ -0,0 +1,329 @@
+#include "jit.h"
+#include "chip8.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define CHIP8_JIT_SUPPORTED 1
+#include <sys/mman.h>
+#endif
+
+// Generated blocks follow the System V calling convention:
+//   rdi = V, rsi = &I, rdx = &PC, rcx = memory
+// and only use rax, r8 and r9 as scratch, all caller-saved, so they need no
+// prologue.
+
+Jit::Jit() {
+#ifdef CHIP8_JIT_SUPPORTED
+    void* p = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        throw std::runtime_error("Unable to map JIT code buffer");
+    }
+
+    code = static_cast<uint8_t*>(p);
+#endif
+    emitted.reserve(MAX_BLOCK_LENGTH * MAX_INSTRUCTION_BYTES);
+}
+
+Jit::~Jit() {
+#ifdef CHIP8_JIT_SUPPORTED
+    if (code != nullptr) {
+        munmap(code, CODE_SIZE);
+        code = nullptr;
+    }
+#endif
+}
+
+bool Jit::supported() {
+#ifdef CHIP8_JIT_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t Jit::step(Chip8& chip8, uint64_t budget) {
+    const uint16_t pc = chip8.PC;
+
+    if (size_t(pc) + 1 >= blocks.size()) {
+        chip8.cycle();
+        return 1;
+    }
+
+    Block& block = blocks[pc];
+    if (!block.compiled) {
+        compile(chip8, pc);
+    }
+
+    if (block.fn == nullptr || block.length > budget) {
+        chip8.cycle();
+        return 1;
+    }
+
+    block.fn(chip8.V.data(), &chip8.I, &chip8.PC, chip8.memory.data());
+    return block.length;
+}
+
+void Jit::invalidate(size_t first, size_t last) {
+    bool stale = false;
+    last = std::min(last, covered.size());
+
+    for (size_t i = first; i < last; ++i) {
+        if (covered[i]) {
+            dirty.set(i);
+            stale = true;
+        }
+    }
+
+    if (stale) {
+        flush();
+    }
+}
+
+void Jit::reset() {
+    flush();
+    dirty.reset();
+}
+
+void Jit::flush() {
+    blocks.fill(Block{});
+    covered.reset();
+    codeUsed = 0;
+}
+
+void Jit::compile(const Chip8& chip8, uint16_t start) {
+    blocks[start] = Block{nullptr, 0, true};
+    emitted.clear();
+
+    uint16_t pc = start;
+    uint16_t length = 0;
+    bool terminates = false;
+
+    while (length < MAX_BLOCK_LENGTH && size_t(pc) + 1 < chip8.memory.size() && !dirty[pc] && !dirty[pc + 1]) {
+        const uint16_t op = (chip8.memory[pc] << 8) | chip8.memory[pc + 1];
+        if (!emitInstruction(chip8, op, pc, terminates)) {
+            break;
+        }
+
+        pc += 2;
+        length++;
+
+        if (terminates) {
+            break;
+        }
+    }
+
+    if (length == 0) {
+        return;
+    }
+
+    if (!terminates) {
+        emitSetPC(pc);
+    }
+
+    if (codeUsed + emitted.size() > CODE_SIZE) {
+        flush();
+        blocks[start] = Block{nullptr, 0, true};
+    }
+
+#ifdef CHIP8_JIT_SUPPORTED
+    mprotect(code, CODE_SIZE, PROT_READ | PROT_WRITE);
+    std::memcpy(code + codeUsed, emitted.data(), emitted.size());
+    mprotect(code, CODE_SIZE, PROT_READ | PROT_EXEC);
+
+    blocks[start] = Block{reinterpret_cast<BlockFn>(code + codeUsed), length, true};
+    codeUsed += emitted.size();
+
+    for (size_t i = start; i < pc; ++i) {
+        covered.set(i);
+    }
+#endif
+}
+
+void Jit::emit(std::initializer_list<uint8_t> bytes) {
+    emitted.insert(emitted.end(), bytes);
+}
+
+void Jit::emit16(uint16_t value) {
+    emit({uint8_t(value), uint8_t(value >> 8)});
+}
+
+void Jit::emit32(uint32_t value) {
+    emit({uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24)});
+}
+
+void Jit::emitSetPC(uint16_t pc) {
+    emit({0x66, 0xC7, 0x02});                   // mov word [rdx], pc
+    emit16(pc);
+    emit({0xC3});                               // ret
+}
+
+// Expects the flags of a compare; cmov selects the skipped-over address.
+void Jit::emitSkip(uint16_t pc, uint8_t cmov) {
+    emit({0xB8});                               // mov eax, pc + 2
+    emit32(pc + 2);
+    emit({0x41, 0xB8});                         // mov r8d, pc + 4
+    emit32(pc + 4);
+    emit({0x41, 0x0F, cmov, 0xC0});             // cmovcc eax, r8d
+    emit({0x66, 0x89, 0x02});                   // mov [rdx], ax
+    emit({0xC3});                               // ret
+}
+
+bool Jit::emitInstruction(const Chip8& chip8, uint16_t op, uint16_t pc, bool& terminates) {
+    constexpr uint8_t CMOVE = 0x44;
+    constexpr uint8_t CMOVNE = 0x45;
+
+    const Decoded d = decode(op);
+    const Quirks& quirks = chip8.settings.quirks;
+
+    switch (op >> 12) {
+        case 0x1: {
+            emitSetPC(d.nnn);
+            terminates = true;
+            return true;
+        }
+
+        case 0x3:
+        case 0x4: {
+            emit({0x80, 0x7F, d.x, d.nn});      // cmp byte [rdi + x], nn
+            emitSkip(pc, (op >> 12) == 0x3 ? CMOVE : CMOVNE);
+            terminates = true;
+            return true;
+        }
+
+        case 0x5:
+        case 0x9: {
+            if (d.n != 0) {
+                return false;
+            }
+
+            emit({0x8A, 0x47, d.x});            // mov al, [rdi + x]
+            emit({0x3A, 0x47, d.y});            // cmp al, [rdi + y]
+            emitSkip(pc, (op >> 12) == 0x5 ? CMOVE : CMOVNE);
+            terminates = true;
+            return true;
+        }
+
+        case 0x6: {
+            emit({0xC6, 0x47, d.x, d.nn});      // mov byte [rdi + x], nn
+            return true;
+        }
+
+        case 0x7: {
+            emit({0x80, 0x47, d.x, d.nn});      // add byte [rdi + x], nn
+            return true;
+        }
+
+        case 0x8: {
+            switch (d.n) {
+                case 0x0: {
+                    emit({0x8A, 0x47, d.y});    // mov al, [rdi + y]
+                    emit({0x88, 0x47, d.x});    // mov [rdi + x], al
+                    return true;
+                }
+
+                case 0x1:
+                case 0x2:
+                case 0x3: {
+                    const uint8_t alu = d.n == 0x1 ? 0x0A : d.n == 0x2 ? 0x22 : 0x32;
+                    emit({0x8A, 0x47, d.x});    // mov al, [rdi + x]
+                    emit({alu, 0x47, d.y});     // or/and/xor al, [rdi + y]
+                    emit({0x88, 0x47, d.x});    // mov [rdi + x], al
+                    if (quirks.vfReset) {
+                        emit({0xC6, 0x47, 0x0F, 0x00}); // mov byte [rdi + 15], 0
+                    }
+                    return true;
+                }
+
+                case 0x4:
+                case 0x5:
+                case 0x7: {
+                    const uint8_t lhs = d.n == 0x7 ? d.y : d.x;
+                    const uint8_t rhs = d.n == 0x7 ? d.x : d.y;
+                    emit({0x8A, 0x47, lhs});    // mov al, [rdi + lhs]
+                    if (d.n == 0x4) {
+                        emit({0x02, 0x47, rhs});            // add al, [rdi + rhs]
+                        emit({0x41, 0x0F, 0x92, 0xC0});     // setc r8b
+                    } else {
+                        emit({0x2A, 0x47, rhs});            // sub al, [rdi + rhs]
+                        emit({0x41, 0x0F, 0x93, 0xC0});     // setnc r8b
+                    }
+                    emit({0x88, 0x47, d.x});                // mov [rdi + x], al
+                    emit({0x44, 0x88, 0x47, 0x0F});         // mov [rdi + 15], r8b
+                    return true;
+                }
+
+                case 0x6:
+                case 0xE: {
+                    emit({0x8A, 0x47, quirks.shift ? d.x : d.y}); // mov al, [rdi + x|y]
+                    emit({0xD0, uint8_t(d.n == 0x6 ? 0xE8 : 0xE0)}); // shr/shl al, 1
+                    emit({0x41, 0x0F, 0x92, 0xC0});         // setc r8b
+                    emit({0x88, 0x47, d.x});                // mov [rdi + x], al
+                    emit({0x44, 0x88, 0x47, 0x0F});         // mov [rdi + 15], r8b
+                    return true;
+                }
+
+                default:
+                    return false;
+            }
+        }
+
+        case 0xA: {
+            emit({0x66, 0xC7, 0x06});           // mov word [rsi], nnn
+            emit16(d.nnn);
+            return true;
+        }
+
+        case 0xF: {
+            switch (d.nn) {
+                case 0x1E: {
+                    emit({0x0F, 0xB6, 0x47, d.x});  // movzx eax, byte [rdi + x]
+                    emit({0x66, 0x01, 0x06});       // add [rsi], ax
+                    return true;
+                }
+
+                case 0x29: {
+                    emit({0x0F, 0xB6, 0x47, d.x});  // movzx eax, byte [rdi + x]
+                    emit({0x8D, 0x84, 0x80});       // lea eax, [rax + rax * 4 + FONT_START]
+                    emit32(FONT_START);
+                    emit({0x66, 0x89, 0x06});       // mov [rsi], ax
+                    return true;
+                }
+
+                case 0x30: {
+                    emit({0x0F, 0xB6, 0x47, d.x});  // movzx eax, byte [rdi + x]
+                    emit({0x83, 0xE0, 0x0F});       // and eax, 0x0F
+                    emit({0x6B, 0xC0, 0x0A});       // imul eax, eax, 10
+                    emit({0x05});                   // add eax, BIGFONT_START
+                    emit32(BIGFONT_START);
+                    emit({0x66, 0x89, 0x06});       // mov [rsi], ax
+                    return true;
+                }
+
+                case 0x65: {
+                    // I + i wraps at the end of memory, as in the interpreter.
+                    emit({0x0F, 0xB7, 0x06});       // movzx eax, word [rsi]
+                    for (uint8_t i = 0; i <= d.x; ++i) {
+                        emit({0x44, 0x8D, 0x48, i});        // lea r9d, [rax + i]
+                        emit({0x41, 0x81, 0xE1});           // and r9d, 0xFFF
+                        emit32(0x0FFF);
+                        emit({0x46, 0x8A, 0x04, 0x09});     // mov r8b, [rcx + r9]
+                        emit({0x44, 0x88, 0x47, i});        // mov [rdi + i], r8b
+                    }
+                    if (quirks.memory) {
+                        emit({0x66, 0x83, 0x06, uint8_t(d.x + 1)}); // add word [rsi], x + 1
+                    }
+                    return true;
+                }
+
+                default:
+                    return false;
+            }
+        }
+
+        default:
+            return false;
+    }
+}
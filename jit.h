@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+class Chip8;
+
+// Translates straight-line runs of CHIP-8 instructions into x86-64 code.
+// A block ends at a jump, skip, or any instruction the JIT does not handle;
+// those (calls, returns, Bnnn, drawing, timers, keypad, Fx33/Fx55 and so
+// on) are left to the interpreter, which remains the reference.
+class Jit {
+
+    public:
+        Jit();
+        ~Jit();
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+        static bool supported();
+
+        // Runs one block (or one interpreted instruction) at the current PC
+        // without exceeding budget, and returns the instructions executed.
+        uint64_t step(Chip8& chip8, uint64_t budget);
+        void invalidate(size_t first, size_t last);
+        void reset();
+
+    private:
+        using BlockFn = void (*)(uint8_t* V, uint16_t* I, uint16_t* PC, uint8_t* memory);
+
+        struct Block {
+            BlockFn fn;
+            uint16_t length;
+            bool compiled;
+        };
+
+        static constexpr size_t CODE_SIZE = 1 << 20;
+        static constexpr size_t MAX_BLOCK_LENGTH = 64;
+        static constexpr size_t MAX_INSTRUCTION_BYTES = 320;
+
+        uint8_t* code = nullptr;
+        size_t codeUsed = 0;
+
+        std::array<Block, 4096> blocks{};
+        // Bytes read by a compiled block, and bytes that were written while
+        // compiled code covered them. Dirty bytes are never compiled again.
+        std::bitset<4096> covered;
+        std::bitset<4096> dirty;
+
+        std::vector<uint8_t> emitted;
+
+        void compile(const Chip8& chip8, uint16_t pc);
+        void flush();
+
+        bool emitInstruction(const Chip8& chip8, uint16_t op, uint16_t pc, bool& terminates);
+        void emit(std::initializer_list<uint8_t> bytes);
+        void emit16(uint16_t value);
+        void emit32(uint32_t value);
+        void emitSetPC(uint16_t pc);
+        void emitSkip(uint16_t pc, uint8_t cmov);
+};
@@ -0,0 +1,759 @@
+#include "lockstep.h"
+#include "xorshift.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+// The group kernels are plain loops over the lane arrays. They are compiled
+// twice, once for the baseline target and once for AVX2, and the AVX2 copy is
+// picked at runtime when the CPU supports it.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CHIP8_LOCKSTEP_AVX2 1
+#define LANES_INLINE __attribute__((always_inline)) inline
+#else
+#define LANES_INLINE inline
+#endif
+
+// Takes value in lanes that are in the group and keeps old in the others.
+// Written as a mask rather than a branch so that every kernel vectorizes.
+template <typename T>
+LANES_INLINE T select(uint8_t in, T value, T old) {
+    const T mask = T(-T(in));
+    return T((value & mask) | (old & T(~mask)));
+}
+
+Lockstep::Lockstep(Settings s, size_t instances, uint32_t seed) {
+    settings = s;
+    count = instances;
+    lanes = (instances + LANE_ALIGN - 1) / LANE_ALIGN * LANE_ALIGN;
+
+#ifdef CHIP8_LOCKSTEP_AVX2
+    avx2 = __builtin_cpu_supports("avx2");
+#else
+    avx2 = false;
+#endif
+
+    for (auto& reg : V) {
+        reg.assign(lanes, 0);
+    }
+
+    I.assign(lanes, 0);
+    PC.assign(lanes, 0);
+    SP.assign(lanes, 0);
+    delayTimer.assign(lanes, 0);
+    soundTimer.assign(lanes, 0);
+    keypad.assign(lanes, 0);
+    prevKeypad.assign(lanes, 0);
+    rngState.assign(lanes, 0);
+    active.assign(lanes, 0);
+    shared.assign(lanes, 0);
+    group.assign(lanes, 0);
+    remaining.assign(lanes, 0);
+    hires.assign(lanes, 0);
+    halted.assign(lanes, 0);
+    stack.assign(lanes, {});
+    RPL.assign(lanes, {});
+    displays.assign(lanes, {});
+    page.assign(lanes, 0);
+
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        rngState[lane] = xorshiftSeed(seed ^ uint32_t(lane * 0x9E3779B9u));
+    }
+}
+
+void Lockstep::init(std::span<const uint8_t> rom) {
+    if (settings.mode == Mode::XO_CHIP) {
+        throw std::runtime_error("XO-CHIP is not supported in lockstep");
+    }
+
+    if (rom.size() > MAX_ROM_SIZE) {
+        throw std::runtime_error("ROM too large");
+    }
+
+    pages.clear();
+    pages.reserve(count + 1);
+    pages.emplace_back();
+
+    Memory& memory = pages[0];
+    memory.fill(0);
+    std::copy(FONTSET.begin(), FONTSET.end(), memory.begin() + FONT_START);
+    std::copy(BIGFONTSET.begin(), BIGFONTSET.end(), memory.begin() + BIGFONT_START);
+    std::copy(rom.begin(), rom.end(), memory.begin() + ROM_START);
+
+    privateLanes = 0;
+
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        for (auto& reg : V) {
+            reg[lane] = 0;
+        }
+
+        I[lane] = 0;
+        PC[lane] = ROM_START;
+        SP[lane] = 0;
+        delayTimer[lane] = 0;
+        soundTimer[lane] = 0;
+        prevKeypad[lane] = keypad[lane];
+        shared[lane] = 1;
+        page[lane] = 0;
+        hires[lane] = 0;
+        // Padding lanes never run.
+        halted[lane] = lane >= count;
+        stack[lane] = {};
+        RPL[lane] = {};
+        displays[lane] = {};
+    }
+}
+
+size_t Lockstep::size() const {
+    return count;
+}
+
+void Lockstep::setKeypad(size_t instance, uint16_t keys) {
+    keypad[instance] = keys;
+}
+
+bool Lockstep::isHalted(size_t instance) const {
+    return halted[instance];
+}
+
+const DisplayBuffer& Lockstep::getDisplayBuffer(size_t instance) const {
+    return displays[instance];
+}
+
+uint64_t Lockstep::groupInstructions() const {
+    return groupCount;
+}
+
+uint64_t Lockstep::scalarInstructions() const {
+    return scalarCount;
+}
+
+void Lockstep::tickTimers() {
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        delayTimer[lane] -= delayTimer[lane] > 0;
+        soundTimer[lane] -= soundTimer[lane] > 0;
+    }
+}
+
+void Lockstep::run(uint64_t cycles) {
+    while (cycles > 0) {
+        const uint32_t chunk = uint32_t(std::min<uint64_t>(cycles, UINT32_MAX));
+
+#ifdef CHIP8_LOCKSTEP_AVX2
+        if (avx2) {
+            runChunkAvx2(chunk);
+        } else {
+            runChunkGeneric(chunk);
+        }
+#else
+        runChunkGeneric(chunk);
+#endif
+
+        cycles -= chunk;
+    }
+}
+
+#ifdef CHIP8_LOCKSTEP_AVX2
+__attribute__((target("avx2"))) void Lockstep::runChunkAvx2(uint32_t cycles) {
+    runChunk(cycles);
+}
+#else
+void Lockstep::runChunkAvx2(uint32_t cycles) {
+    runChunk(cycles);
+}
+#endif
+
+void Lockstep::runChunkGeneric(uint32_t cycles) {
+    runChunk(cycles);
+}
+
+// Each pass picks the lowest PC among the shared-memory lanes and runs every
+// lane sitting there as one group. Lanes that fell behind on a branch catch
+// up this way, so diverged lanes tend to meet again at the next common PC.
+// When the group is too small to pay for a pass over all lanes, every lane
+// takes one scalar step instead.
+LANES_INLINE void Lockstep::runChunk(uint32_t cycles) {
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        remaining[lane] = halted[lane] ? 0 : cycles;
+        active[lane] = !halted[lane] && cycles != 0;
+    }
+
+    for (;;) {
+        bool privatePending = false;
+
+        if (privateLanes > 0) {
+            for (size_t lane = 0; lane < lanes; ++lane) {
+                if (!shared[lane] && active[lane]) {
+                    step(lane);
+                    privatePending = true;
+                }
+            }
+        }
+
+        uint16_t pc = 0;
+        uint32_t pending = 0;
+        const uint32_t size = selectGroup(pc, pending);
+
+        if (pending == 0) {
+            if (!privatePending) {
+                break;
+            }
+
+            continue;
+        }
+
+        if (size < MIN_GROUP && size < pending) {
+            sweepScalar();
+            continue;
+        }
+
+        const Memory& memory = pages[0];
+        const uint16_t op = uint16_t((memory[pc & 0x0FFF] << 8) | memory[(pc + 1) & 0x0FFF]);
+
+        if (executeGroup(pc, op, size)) {
+            groupCount += size;
+        } else {
+            executeGroupScalar(op);
+            scalarCount += size;
+        }
+
+        retireGroup();
+    }
+}
+
+// Marks the active shared-memory lanes at the lowest PC as the group, and
+// returns its size along with how many shared-memory lanes are still active.
+LANES_INLINE uint32_t Lockstep::selectGroup(uint16_t& pc, uint32_t& pending) {
+    // Byte stores may alias anything, so the arrays are read through locals
+    // to keep these loops vectorizable.
+    const size_t n = lanes;
+    const uint8_t* act = active.data();
+    const uint8_t* sh = shared.data();
+    const uint16_t* pcs = PC.data();
+    uint8_t* g = group.data();
+
+    uint16_t lowest = 0xFFFF;
+    uint32_t candidates = 0;
+
+    for (size_t k = 0; k < n; ++k) {
+        const uint8_t candidate = act[k] & sh[k];
+        lowest = std::min<uint16_t>(lowest, select<uint16_t>(candidate, pcs[k], 0xFFFF));
+        candidates += candidate;
+    }
+
+    uint32_t size = 0;
+
+    for (size_t k = 0; k < n; ++k) {
+        g[k] = act[k] & sh[k] & (pcs[k] == lowest);
+        size += g[k];
+    }
+
+    pc = lowest;
+    pending = candidates;
+
+    return size;
+}
+
+// Restrict only holds for parameters, so the loop lives in its own function.
+LANES_INLINE void retireLanes(size_t n, const uint8_t* __restrict g, const uint8_t* __restrict stopped,
+                              const uint16_t* __restrict keys, uint32_t* __restrict left,
+                              uint8_t* __restrict act, uint16_t* __restrict prev) {
+    for (size_t k = 0; k < n; ++k) {
+        left[k] -= g[k];
+        act[k] = uint8_t(left[k] != 0) & uint8_t(!stopped[k]);
+        prev[k] = select(g[k], keys[k], prev[k]);
+    }
+}
+
+LANES_INLINE void Lockstep::retireGroup() {
+    retireLanes(lanes, group.data(), halted.data(), keypad.data(), remaining.data(),
+                active.data(), prevKeypad.data());
+}
+
+// Runs op on every lane in the group at once. Returns false for the
+// instructions that have no group form; those run lane by lane instead.
+LANES_INLINE bool Lockstep::executeGroup(uint16_t pc, uint16_t op, uint32_t size) {
+    const Decoded d = decode(op);
+    const size_t n = lanes;
+    const uint8_t nn = d.nn;
+    const uint16_t nnn = d.nnn;
+    const uint8_t* g = group.data();
+    uint8_t* dt = delayTimer.data();
+    uint8_t* st = soundTimer.data();
+    uint8_t* vx = V[d.x].data();
+    const uint8_t* vy = V[d.y].data();
+    uint8_t* vf = V[0xF].data();
+    uint16_t* pcs = PC.data();
+    uint16_t* is = I.data();
+    const uint16_t next = uint16_t(pc + 2);
+    const uint16_t skip = uint16_t(pc + 4);
+    const Quirks& q = settings.quirks;
+
+    auto setVx = [=](auto value) {
+        for (size_t k = 0; k < n; ++k) {
+            const uint8_t result = uint8_t(value(k));
+            vx[k] = select<uint8_t>(g[k], result, vx[k]);
+        }
+    };
+
+    // Sets Vx and then VF, in that order, as the interpreter does.
+    auto setVxVf = [=](auto value, auto flag) {
+        for (size_t k = 0; k < n; ++k) {
+            const uint8_t result = uint8_t(value(k));
+            const uint8_t carry = uint8_t(flag(k));
+            vx[k] = select<uint8_t>(g[k], result, vx[k]);
+            vf[k] = select<uint8_t>(g[k], carry, vf[k]);
+        }
+    };
+
+    auto setI = [=](auto value) {
+        for (size_t k = 0; k < n; ++k) {
+            const uint16_t result = uint16_t(value(k));
+            is[k] = select<uint16_t>(g[k], result, is[k]);
+        }
+    };
+
+    auto skipIf = [=](auto condition) {
+        for (size_t k = 0; k < n; ++k) {
+            const uint16_t target = condition(k) ? skip : next;
+            pcs[k] = select<uint16_t>(g[k], target, pcs[k]);
+        }
+    };
+
+    auto resetVf = [=]() {
+        for (size_t k = 0; k < n; ++k) {
+            vf[k] = select<uint8_t>(g[k], 0, vf[k]);
+        }
+    };
+
+    switch (op >> 12) {
+        case 0x1: {
+            for (size_t k = 0; k < n; ++k) {
+                pcs[k] = select<uint16_t>(g[k], nnn, pcs[k]);
+            }
+            return true;
+        }
+
+        case 0x3: skipIf([=](size_t k) { return vx[k] == nn; }); return true;
+        case 0x4: skipIf([=](size_t k) { return vx[k] != nn; }); return true;
+
+        case 0x5:
+            if (d.n != 0) return false;
+            skipIf([=](size_t k) { return vx[k] == vy[k]; });
+            return true;
+
+        case 0x9:
+            if (d.n != 0) return false;
+            skipIf([=](size_t k) { return vx[k] != vy[k]; });
+            return true;
+
+        case 0x6: setVx([=](size_t) { return nn; }); break;
+        case 0x7: setVx([=](size_t k) { return vx[k] + nn; }); break;
+        case 0xA: setI([=](size_t) { return nnn; }); break;
+
+        case 0x8: {
+            switch (d.n) {
+                case 0x0: setVx([=](size_t k) { return vy[k]; }); break;
+
+                case 0x1:
+                    setVx([=](size_t k) { return vx[k] | vy[k]; });
+                    if (q.vfReset) resetVf();
+                    break;
+
+                case 0x2:
+                    setVx([=](size_t k) { return vx[k] & vy[k]; });
+                    if (q.vfReset) resetVf();
+                    break;
+
+                case 0x3:
+                    setVx([=](size_t k) { return vx[k] ^ vy[k]; });
+                    if (q.vfReset) resetVf();
+                    break;
+
+                case 0x4:
+                    setVxVf([=](size_t k) { return vx[k] + vy[k]; },
+                            [=](size_t k) { return vx[k] + vy[k] > 0xFF; });
+                    break;
+
+                case 0x5:
+                    setVxVf([=](size_t k) { return vx[k] - vy[k]; },
+                            [=](size_t k) { return vx[k] >= vy[k]; });
+                    break;
+
+                case 0x7:
+                    setVxVf([=](size_t k) { return vy[k] - vx[k]; },
+                            [=](size_t k) { return vy[k] >= vx[k]; });
+                    break;
+
+                case 0x6: {
+                    const uint8_t* src = q.shift ? vx : vy;
+                    setVxVf([=](size_t k) { return src[k] >> 1; },
+                            [=](size_t k) { return src[k] & 0x1; });
+                    break;
+                }
+
+                case 0xE: {
+                    const uint8_t* src = q.shift ? vx : vy;
+                    setVxVf([=](size_t k) { return src[k] << 1; },
+                            [=](size_t k) { return src[k] >> 7; });
+                    break;
+                }
+
+                default:
+                    return false;
+            }
+            break;
+        }
+
+        case 0xF: {
+            switch (nn) {
+                case 0x07: setVx([=](size_t k) { return dt[k]; }); break;
+                case 0x1E: setI([=](size_t k) { return is[k] + vx[k]; }); break;
+                case 0x29: setI([=](size_t k) { return FONT_START + vx[k] * 5; }); break;
+                case 0x30: setI([=](size_t k) { return BIGFONT_START + (vx[k] & 0x0F) * 10; }); break;
+
+                case 0x15:
+                    for (size_t k = 0; k < n; ++k) {
+                        dt[k] = select<uint8_t>(g[k], vx[k], dt[k]);
+                    }
+                    break;
+
+                case 0x18:
+                    for (size_t k = 0; k < n; ++k) {
+                        st[k] = select<uint8_t>(g[k], vx[k], st[k]);
+                    }
+                    break;
+
+                case 0x33:
+                case 0x55:
+                    if (!writeShared(d, size)) return false;
+                    if (nn == 0x55 && q.memory) setI([=](size_t k) { return is[k] + d.x + 1; });
+                    break;
+
+                default:
+                    return false;
+            }
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    for (size_t k = 0; k < n; ++k) {
+        pcs[k] = select<uint16_t>(g[k], next, pcs[k]);
+    }
+
+    return true;
+}
+
+// A store can go straight to the shared image only if every lane that reads
+// that image is in the group and they would all write the same bytes.
+// Otherwise each lane takes a private copy on the scalar path.
+bool Lockstep::writeShared(const Decoded& d, uint32_t size) {
+    if (size != count - privateLanes) {
+        return false;
+    }
+
+    const size_t first = size_t(std::find(group.begin(), group.end(), 1) - group.begin());
+    const int last = d.nn == 0x33 ? d.x : 0;
+
+    for (size_t lane = first + 1; lane < lanes; ++lane) {
+        if (!group[lane]) {
+            continue;
+        }
+
+        if (I[lane] != I[first]) {
+            return false;
+        }
+
+        for (int r = last; r <= d.x; ++r) {
+            if (V[r][lane] != V[r][first]) {
+                return false;
+            }
+        }
+    }
+
+    Memory& memory = pages[0];
+    const uint16_t i = I[first];
+
+    if (d.nn == 0x33) {
+        const uint8_t n = V[d.x][first];
+        memory[i & 0x0FFF] = n / 100;
+        memory[(i + 1) & 0x0FFF] = (n / 10) % 10;
+        memory[(i + 2) & 0x0FFF] = n % 10;
+    } else {
+        for (int r = 0; r <= d.x; ++r) {
+            memory[(i + r) & 0x0FFF] = V[r][first];
+        }
+    }
+
+    return true;
+}
+
+void Lockstep::executeGroupScalar(uint16_t op) {
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        if (group[lane]) {
+            PC[lane] += 2;
+            execute(lane, op);
+        }
+    }
+}
+
+void Lockstep::sweepScalar() {
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        if (shared[lane] && active[lane]) {
+            step(lane);
+        }
+    }
+}
+
+void Lockstep::step(size_t lane) {
+    const Memory& memory = pages[page[lane]];
+    const uint16_t pc = PC[lane] & 0x0FFF;
+    const uint16_t op = uint16_t((memory[pc] << 8) | memory[(pc + 1) & 0x0FFF]);
+
+    PC[lane] += 2;
+    execute(lane, op);
+    prevKeypad[lane] = keypad[lane];
+
+    remaining[lane]--;
+    active[lane] = remaining[lane] != 0 && !halted[lane];
+    scalarCount++;
+}
+
+Lockstep::Memory& Lockstep::writableMemory(size_t lane) {
+    if (page[lane] == 0) {
+        page[lane] = uint32_t(pages.size());
+        pages.push_back(pages[0]);
+        shared[lane] = 0;
+        privateLanes++;
+    }
+
+    return pages[page[lane]];
+}
+
+uint8_t Lockstep::nextRandom(size_t lane) {
+    rngState[lane] = xorshift32(rngState[lane]);
+
+    return uint8_t(rngState[lane] >> 24);
+}
+
+// The scalar path implements the whole instruction set with the same
+// semantics as Chip8's handlers, on one lane's slice of the state.
+void Lockstep::execute(size_t lane, uint16_t op) {
+    const Decoded d = decode(op);
+    const Quirks& q = settings.quirks;
+    uint8_t& vx = V[d.x][lane];
+    const uint8_t vy = V[d.y][lane];
+    uint8_t& vf = V[0xF][lane];
+    uint16_t& pc = PC[lane];
+    uint16_t& i = I[lane];
+    DisplayBuffer& display = displays[lane];
+
+    auto unhandled = [op]() {
+        std::fprintf(stderr, "Unhandled opcode: %04X\n", op);
+    };
+
+    switch (op >> 12) {
+        case 0x0: {
+            if (op == 0x00E0) {
+                display.fill(DisplayRow{});
+            } else if (op == 0x00EE) {
+                if (SP[lane] == 0) {
+                    std::fprintf(stderr, "Stack underflow\n");
+                    halted[lane] = 1;
+                    pc -= 2;
+                    break;
+                }
+                pc = stack[lane][--SP[lane]];
+            } else if (op == 0x00FE || op == 0x00FF) {
+                display.fill(DisplayRow{});
+                hires[lane] = op == 0x00FF;
+            } else if ((op & 0xFFF0) == 0x00C0) {
+                scrollDown(display, d.n, hires[lane]);
+            } else if (op == 0x00FB) {
+                scrollRight(display, hires[lane]);
+            } else if (op == 0x00FC) {
+                scrollLeft(display, hires[lane]);
+            } else if (op == 0x00FD) {
+                halted[lane] = 1;
+            } else {
+                unhandled();
+            }
+            break;
+        }
+
+        case 0x1: pc = d.nnn; break;
+
+        case 0x2: {
+            if (SP[lane] >= 16) {
+                std::fprintf(stderr, "Stack overflow\n");
+                halted[lane] = 1;
+                pc -= 2;
+                break;
+            }
+            stack[lane][SP[lane]++] = pc;
+            pc = d.nnn;
+            break;
+        }
+
+        case 0x3: pc += (vx == d.nn) ? 2 : 0; break;
+        case 0x4: pc += (vx != d.nn) ? 2 : 0; break;
+
+        case 0x5:
+            if (d.n == 0) pc += (vx == vy) ? 2 : 0;
+            else unhandled();
+            break;
+
+        case 0x6: vx = d.nn; break;
+        case 0x7: vx = uint8_t(vx + d.nn); break;
+
+        case 0x8: {
+            switch (d.n) {
+                case 0x0: vx = vy; break;
+                case 0x1: vx |= vy; if (q.vfReset) vf = 0; break;
+                case 0x2: vx &= vy; if (q.vfReset) vf = 0; break;
+                case 0x3: vx ^= vy; if (q.vfReset) vf = 0; break;
+
+                case 0x4: {
+                    const uint16_t r = uint16_t(vx + vy);
+                    vx = uint8_t(r);
+                    vf = r > 0xFF;
+                    break;
+                }
+
+                case 0x5: {
+                    const uint8_t x = vx;
+                    vx = uint8_t(x - vy);
+                    vf = x >= vy;
+                    break;
+                }
+
+                case 0x7: {
+                    const uint8_t x = vx;
+                    vx = uint8_t(vy - x);
+                    vf = vy >= x;
+                    break;
+                }
+
+                case 0x6: {
+                    const uint8_t src = q.shift ? vx : vy;
+                    vx = src >> 1;
+                    vf = src & 0x1;
+                    break;
+                }
+
+                case 0xE: {
+                    const uint8_t src = q.shift ? vx : vy;
+                    vx = uint8_t(src << 1);
+                    vf = src >> 7;
+                    break;
+                }
+
+                default: unhandled(); break;
+            }
+            break;
+        }
+
+        case 0x9:
+            if (d.n == 0) pc += (vx != vy) ? 2 : 0;
+            else unhandled();
+            break;
+
+        case 0xA: i = d.nnn; break;
+        case 0xB: pc = uint16_t(d.nnn + V[q.jump ? d.x : 0][lane]); break;
+        case 0xC: vx = nextRandom(lane) & d.nn; break;
+
+        case 0xD: {
+            const Memory& memory = pages[page[lane]];
+            const bool collision = q.clipping
+                ? drawSprite<true>(display, memory, i, vx, vy, d.n, hires[lane])
+                : drawSprite<false>(display, memory, i, vx, vy, d.n, hires[lane]);
+            vf = collision;
+            break;
+        }
+
+        case 0xE: {
+            const bool pressed = (keypad[lane] >> (vx & 0x0F)) & 1;
+            if (d.nn == 0x9E) pc += pressed ? 2 : 0;
+            else if (d.nn == 0xA1) pc += pressed ? 0 : 2;
+            else unhandled();
+            break;
+        }
+
+        case 0xF: {
+            switch (d.nn) {
+                case 0x07: vx = delayTimer[lane]; break;
+
+                case 0x0A: {
+                    const uint16_t before = prevKeypad[lane];
+                    const uint16_t now = keypad[lane];
+                    const uint16_t edges = q.press ? (now & ~before) : (before & ~now);
+
+                    if (edges != 0) {
+                        vx = uint8_t(std::countr_zero(edges));
+                    } else {
+                        pc -= 2;
+                    }
+                    break;
+                }
+
+                case 0x15: delayTimer[lane] = vx; break;
+                case 0x18: soundTimer[lane] = vx; break;
+                case 0x1E: i += vx; break;
+                case 0x29: i = uint16_t(FONT_START + vx * 5); break;
+                case 0x30: i = uint16_t(BIGFONT_START + (vx & 0x0F) * 10); break;
+
+                case 0x33: {
+                    const uint8_t n = vx;
+                    Memory& memory = writableMemory(lane);
+                    memory[i & 0x0FFF] = n / 100;
+                    memory[(i + 1) & 0x0FFF] = (n / 10) % 10;
+                    memory[(i + 2) & 0x0FFF] = n % 10;
+                    break;
+                }
+
+                case 0x55: {
+                    Memory& memory = writableMemory(lane);
+                    for (int r = 0; r <= d.x; ++r) {
+                        memory[(i + r) & 0x0FFF] = V[r][lane];
+                    }
+                    if (q.memory) i += d.x + 1;
+                    break;
+                }
+
+                case 0x65: {
+                    const Memory& memory = pages[page[lane]];
+                    for (int r = 0; r <= d.x; ++r) {
+                        V[r][lane] = memory[(i + r) & 0x0FFF];
+                    }
+                    if (q.memory) i += d.x + 1;
+                    break;
+                }
+
+                case 0x75: {
+                    const int n = std::min(d.x + 1, 8);
+                    for (int r = 0; r < n; ++r) {
+                        RPL[lane][r] = V[r][lane];
+                    }
+                    break;
+                }
+
+                case 0x85: {
+                    const int n = std::min(d.x + 1, 8);
+                    for (int r = 0; r < n; ++r) {
+                        V[r][lane] = RPL[lane][r];
+                    }
+                    break;
+                }
+
+                default: unhandled(); break;
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "settings.h"
+#include "chip8.h"
+#include "display_buffer.h"
+
+// Runs many copies of one ROM side by side, for fuzzing and search where
+// thousands of instances differ only in their input. State is stored as
+// structure-of-arrays (V[register][lane], PC[lane], ...), so lanes that sit
+// at the same PC execute an instruction together as a single pass over
+// contiguous arrays, which the compiler turns into AVX2 code where the CPU
+// has it. Lanes that have diverged are stepped one at a time until they
+// meet again.
+//
+// Memory is copy-on-write: every lane reads the shared image until it
+// first writes to memory, after which it gets a private copy and always
+// runs on the scalar path.
+class Lockstep {
+
+    public:
+        Lockstep(Settings settings, size_t instances, uint32_t seed);
+        void init(std::span<const uint8_t> rom);
+
+        // Executes cycles instructions on every instance that has not halted.
+        void run(uint64_t cycles);
+        void tickTimers();
+
+        size_t size() const;
+        void setKeypad(size_t instance, uint16_t keys);
+        bool isHalted(size_t instance) const;
+        const DisplayBuffer& getDisplayBuffer(size_t instance) const;
+
+        // Instructions executed as part of a group and one lane at a time.
+        uint64_t groupInstructions() const;
+        uint64_t scalarInstructions() const;
+
+    private:
+        using Memory = std::array<uint8_t, 4096>;
+
+        // Lanes are padded to a whole number of AVX2 byte vectors.
+        static constexpr size_t LANE_ALIGN = 32;
+        // Below this many lanes a group is not worth a pass over every lane.
+        static constexpr uint32_t MIN_GROUP = 4;
+
+        Settings settings;
+        size_t count;
+        size_t lanes;
+        bool avx2;
+
+        std::array<std::vector<uint8_t>, 16> V;
+        std::vector<uint16_t> I;
+        std::vector<uint16_t> PC;
+        std::vector<uint8_t> SP;
+        std::vector<uint8_t> delayTimer;
+        std::vector<uint8_t> soundTimer;
+        std::vector<uint16_t> keypad;
+        std::vector<uint16_t> prevKeypad;
+        std::vector<uint32_t> rngState;
+
+        // Per-lane flags, 0 or 1 so they can be used directly as masks.
+        std::vector<uint8_t> active;
+        std::vector<uint8_t> shared;
+        std::vector<uint8_t> group;
+        std::vector<uint32_t> remaining;
+
+        std::vector<uint8_t> hires;
+        std::vector<uint8_t> halted;
+        std::vector<std::array<uint16_t, 16>> stack;
+        std::vector<std::array<uint8_t, 8>> RPL;
+        std::vector<DisplayBuffer> displays;
+
+        // Page 0 is the image shared by every lane that has not written memory.
+        std::vector<uint32_t> page;
+        std::vector<Memory> pages;
+        size_t privateLanes = 0;
+
+        uint64_t groupCount = 0;
+        uint64_t scalarCount = 0;
+
+        void runChunk(uint32_t cycles);
+        void runChunkAvx2(uint32_t cycles);
+        void runChunkGeneric(uint32_t cycles);
+
+        uint32_t selectGroup(uint16_t& pc, uint32_t& pending);
+        bool executeGroup(uint16_t pc, uint16_t op, uint32_t size);
+        bool writeShared(const Decoded& d, uint32_t size);
+        void retireGroup();
+        void executeGroupScalar(uint16_t op);
+        void sweepScalar();
+
+        void step(size_t lane);
+        void execute(size_t lane, uint16_t op);
+        Memory& writableMemory(size_t lane);
+        uint8_t nextRandom(size_t lane);
+};
@@ -1,15 +1,22 @@
 #include <iostream>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <csignal>
 #include <SDL.h>
 
 #include "window.h"
 #include "audio.h"
-#include "chip8.h"
+#include "emulator.h"
 #include "arg_parser.h"
+#include "frame_pacer.h"
+#include "video_dump.h"
+#include "terminal.h"
 
-const double CPU_TICK_DURATION = 1.0 / 500.0;
+const double FRAME_DURATION = 1.0 / 60.0;
 const double TIMER_TICK_DURATION = 1.0 / 60.0;
-const double DISPLAY_DRAW_DURATION = 1.0 / 60.0;
-const double INPUT_READ_DURATION = 1.0 / 60.0;
+const double TITLE_UPDATE_DURATION = 1.0;
+const uint64_t DEFAULT_VIDEO_FRAMES = 600;
 
 double freq = SDL_GetPerformanceFrequency();
 
@@ -17,12 +24,139 @@ double hiresTime() {
     return (double)SDL_GetPerformanceCounter() / freq;
 }
 
-int main(int argc, char* argv[]) {
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
-        std::printf("SDL_Init error: %s\n", SDL_GetError());
+#ifdef CHIP8_OPCODE_STATS
+// Set by SIGUSR1 to ask for the opcode counters without quitting.
+static volatile std::sig_atomic_t opcodeStatsRequested = 0;
+
+static void requestOpcodeStats(int) {
+    opcodeStatsRequested = 1;
+}
+#endif
+
+// The host keys for each CHIP-8 key, 0x0 to 0xF.
+static const SDL_Scancode KEYMAP[16] = {
+    SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+    SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
+    SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
+    SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V,
+};
+
+// The speed multiplier, shown whenever the game is not at real time.
+static std::string speedText(double speed) {
+    char text[16] = "";
+    if (speed < 0.95 || speed > 1.05) {
+        std::snprintf(text, sizeof(text), speed < 10 ? "x%.1f" : "x%.0f", speed);
+    }
+
+    return text;
+}
+
+// Runs the emulator with the terminal for its display and keyboard.
+static int runTerminal(const Settings& settings, const std::string& recordPath, const std::string& replayPath,
+                       const std::string& profilePath) {
+    std::unique_ptr<Emulator> emulator;
+    try {
+        emulator = std::make_unique<Emulator>(settings, recordPath, replayPath, profilePath);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+
+        return 1;
+    }
+
+    auto terminal = std::make_unique<Terminal>();
+    if (terminal->init() == 1) {
         return 1;
     }
 
+    bool beeping = false;
+    FramePacer pacer(FRAME_DURATION);
+
+#if defined(CHIP8_OPCODE_STATS) && defined(SIGUSR1)
+    std::signal(SIGUSR1, requestOpcodeStats);
+#endif
+
+    emulator->start();
+
+    for (;;) {
+        const Terminal::Input input = terminal->poll();
+        if (input.quit) {
+            break;
+        }
+
+        emulator->setKeypad(input.keypad);
+        emulator->setRewinding(input.rewind);
+        emulator->setTurbo(input.turbo);
+
+#ifdef CHIP8_OPCODE_STATS
+        if (opcodeStatsRequested) {
+            opcodeStatsRequested = 0;
+            emulator->requestOpcodeStats();
+        }
+#endif
+
+        if (emulator->frames().update()) {
+            const Emulator::Frame& frame = emulator->frames().front();
+
+            // The terminal has one colour, so every lit plane shows in it.
+            terminal->draw(mergePlanes(frame.display), frame.hires, speedText(frame.speed));
+
+            // A terminal can only ring its bell, so that is done when a
+            // beep starts.
+            if (frame.sound.beeping && !beeping) {
+                terminal->beep();
+            }
+            beeping = frame.sound.beeping;
+
+            if (frame.halted) {
+                break;
+            }
+        }
+
+        pacer.wait();
+    }
+
+    // Restored first, so that what the emulator prints as it stops stays
+    // on screen.
+    terminal.reset();
+    emulator->stop();
+
+    return 0;
+}
+
+// Runs without a window, as fast as the host allows, and writes every frame
+// to a video until the frame budget runs out or the ROM halts.
+static int dumpVideo(const Settings& settings, const std::string& recordPath, const std::string& replayPath,
+                     const std::string& profilePath, const std::string& videoPath, VideoDump::Format format,
+                     int scale, uint64_t frames) {
+    try {
+        Emulator emulator(settings, recordPath, replayPath, profilePath);
+
+        const bool hires = settings.mode != Mode::CHIP_8;
+        VideoDump dump(videoPath, format, displayWidth(hires), displayHeight(hires), scale);
+
+        for (uint64_t i = 0; i < frames; ++i) {
+            emulator.step();
+            emulator.frames().update();
+
+            const Emulator::Frame& frame = emulator.frames().front();
+            dump.write(frame.display, frame.hires);
+
+            if (frame.halted) {
+                break;
+            }
+        }
+
+        emulator.stop();
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
     Settings settings = ArgParser::parse(argc, argv);
 
     if (settings.rom.size() == 0) {
@@ -30,6 +164,73 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    std::string recordPath;
+    std::string replayPath;
+    std::string profilePath;
+    std::string videoPath;
+    std::string videoFormat;
+    int videoScale = 1;
+    uint64_t videoFrames = DEFAULT_VIDEO_FRAMES;
+    bool useTerminal = false;
+    bool lowLatencyAudio = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        try {
+            if (arg.rfind("--record=", 0) == 0) {
+                recordPath = arg.substr(9);
+            } else if (arg.rfind("--replay=", 0) == 0) {
+                replayPath = arg.substr(9);
+            } else if (arg.rfind("--profile=", 0) == 0) {
+                profilePath = arg.substr(10);
+            } else if (arg.rfind("--dump-video=", 0) == 0) {
+                videoPath = arg.substr(13);
+            } else if (arg.rfind("--video-format=", 0) == 0) {
+                videoFormat = arg.substr(15);
+            } else if (arg.rfind("--video-scale=", 0) == 0) {
+                videoScale = std::clamp(std::stoi(arg.substr(14)), 1, 64);
+            } else if (arg.rfind("--frames=", 0) == 0) {
+                videoFrames = std::stoull(arg.substr(9));
+            } else if (arg == "--terminal") {
+                useTerminal = true;
+            } else if (arg == "--low-latency-audio") {
+                lowLatencyAudio = true;
+            }
+        } catch (const std::exception&) {
+            std::fprintf(stderr, "Invalid number in %s\n", arg.c_str());
+        }
+    }
+
+    if (!videoPath.empty()) {
+        VideoDump::Format format = VideoDump::formatFor(videoPath);
+        if (videoFormat == "y4m") {
+            format = VideoDump::Format::Y4M;
+        } else if (videoFormat == "rgba") {
+            format = VideoDump::Format::RGBA;
+        }
+
+        return dumpVideo(settings, recordPath, replayPath, profilePath, videoPath, format, videoScale, videoFrames);
+    }
+
+    if (useTerminal) {
+        return runTerminal(settings, recordPath, replayPath, profilePath);
+    }
+
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
+        std::fprintf(stderr, "SDL_Init error: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    std::unique_ptr<Emulator> emulator;
+    try {
+        emulator = std::make_unique<Emulator>(settings, recordPath, replayPath, profilePath);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        SDL_Quit();
+
+        return 1;
+    }
+
     Window window;
     if (window.init() == 1) {
         SDL_Quit();
@@ -38,35 +239,44 @@ int main(int argc, char* argv[]) {
     };
 
     Audio audio;
-    if (audio.init() == 1) {
+    if (audio.init(lowLatencyAudio ? Audio::Mode::QUEUE : Audio::Mode::CALLBACK) == 1) {
         SDL_Quit();
 
         return 1;
     };
 
-    Chip8 chip8(settings);
-    chip8.init();
+    // In low-latency mode the emulation thread pushes each timer tick's
+    // sound itself, so beeps line up with the ticks exactly.
+    if (lowLatencyAudio) {
+        emulator->setTimerListener([&audio](const Sound& sound) {
+            audio.queueTick(sound);
+        });
+    }
 
-    double previousTime = hiresTime();
     SDL_Event event;
     bool quit = false;
-    double cpuAccumulator = 0;
-    double timerAccumulator = 0;
-    double displayAccumulator = 0;
-    double inputDelayTimer = 0;
+    double titleAccumulator = 0;
+    double previousTime = hiresTime();
+
+    bool currentIsHires = false;
+    uint64_t lastSequence = 0;
+
+    // This thread only handles input and presents frames; the emulator runs
+    // and paces itself on its own thread, so a slow present here never
+    // holds it up.
+    FramePacer pacer(FRAME_DURATION);
 
-    int currentIsHires = chip8.isHires();
+#if defined(CHIP8_OPCODE_STATS) && defined(SIGUSR1)
+    std::signal(SIGUSR1, requestOpcodeStats);
+#endif
+
+    emulator->start();
 
     while (!quit) {
         double now = hiresTime();
-        double delta = std::clamp(now - previousTime, 0.0, 0.25);
+        titleAccumulator += now - previousTime;
         previousTime = now;
 
-        cpuAccumulator += delta;
-        timerAccumulator += delta;
-        displayAccumulator += delta;
-        inputDelayTimer += delta;
-
         while (SDL_PollEvent(&event))  {
             SDL_EventType type = (SDL_EventType)event.type;
             SDL_KeyCode sym = (SDL_KeyCode)event.key.keysym.sym;
@@ -75,63 +285,85 @@ int main(int argc, char* argv[]) {
                 quit = true;
                 break;
             }
+
+            if (type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+                window.invalidate();
+            }
         }
 
-        if (inputDelayTimer >= INPUT_READ_DURATION) {
-            const Uint8* keyStates = SDL_GetKeyboardState(NULL);
+        const Uint8* keyStates = SDL_GetKeyboardState(NULL);
 
-            chip8.keypad[0x1] = keyStates[SDL_SCANCODE_1];
-            chip8.keypad[0x2] = keyStates[SDL_SCANCODE_2];
-            chip8.keypad[0x3] = keyStates[SDL_SCANCODE_3];
-            chip8.keypad[0xC] = keyStates[SDL_SCANCODE_4];
+        uint16_t keys = 0;
+        for (int key = 0; key < 16; ++key) {
+            keys |= uint16_t(keyStates[KEYMAP[key]] != 0) << key;
+        }
+        emulator->setKeypad(keys);
 
-            chip8.keypad[0x4] = keyStates[SDL_SCANCODE_Q];
-            chip8.keypad[0x5] = keyStates[SDL_SCANCODE_W];
-            chip8.keypad[0x6] = keyStates[SDL_SCANCODE_E];
-            chip8.keypad[0xD] = keyStates[SDL_SCANCODE_R];
+        // Holding backspace plays the game backwards, a frame per timer tick.
+        emulator->setRewinding(keyStates[SDL_SCANCODE_BACKSPACE]);
+        // Holding tab runs it as fast as the host allows.
+        emulator->setTurbo(keyStates[SDL_SCANCODE_TAB]);
 
-            chip8.keypad[0x7] = keyStates[SDL_SCANCODE_A];
-            chip8.keypad[0x8] = keyStates[SDL_SCANCODE_S];
-            chip8.keypad[0x9] = keyStates[SDL_SCANCODE_D];
-            chip8.keypad[0xE] = keyStates[SDL_SCANCODE_F];
+#ifdef CHIP8_OPCODE_STATS
+        if (opcodeStatsRequested) {
+            opcodeStatsRequested = 0;
+            emulator->requestOpcodeStats();
+        }
+#endif
 
-            chip8.keypad[0xA] = keyStates[SDL_SCANCODE_Z];
-            chip8.keypad[0x0] = keyStates[SDL_SCANCODE_X];
-            chip8.keypad[0xB] = keyStates[SDL_SCANCODE_C];
-            chip8.keypad[0xF] = keyStates[SDL_SCANCODE_V];
+        uint64_t dirtyRows = 0;
+        if (emulator->frames().update()) {
+            const Emulator::Frame& frame = emulator->frames().front();
 
-            inputDelayTimer -= INPUT_READ_DURATION;
-        }
+            if (currentIsHires != frame.hires) {
+                currentIsHires = frame.hires;
 
-        while (cpuAccumulator >= CPU_TICK_DURATION) {
-            chip8.cycle();
-            cpuAccumulator -= CPU_TICK_DURATION;
-        }
+                window.setLogicalSize(displayWidth(frame.hires), displayHeight(frame.hires));
+            }
 
-        while (timerAccumulator >= TIMER_TICK_DURATION) {
-            chip8.tickTimers();
-            timerAccumulator -= TIMER_TICK_DURATION;
-        }
+            // Missed frames took their dirty rows with them.
+            dirtyRows = (frame.sequence == lastSequence + 1) ? frame.dirtyRows : ALL_ROWS;
+            lastSequence = frame.sequence;
 
-        if (currentIsHires != chip8.isHires()) {
-            currentIsHires = chip8.isHires();
+            if (!lowLatencyAudio) {
+                audio.setSound(frame.sound);
+            }
 
-            window.setLogicalSize(chip8.screenWidth(), chip8.screenHeight());
-        }
+            window.setOverlay(speedText(frame.speed));
+
+            if (titleAccumulator >= TITLE_UPDATE_DURATION) {
+                char title[160];
+                int length = std::snprintf(title, sizeof(title), "chip8 - rewind %.1f s, %.0f B/frame, %.2f of %.0f MB - jitter %.2f ms, CPU %.0f%%",
+                                           frame.rewindFrames * TIMER_TICK_DURATION, frame.rewindFrameBytes,
+                                           frame.rewindBytes / 1048576.0, frame.rewindCapacity / 1048576.0,
+                                           frame.pacing.jitterMs, frame.pacing.cpuPercent);
+                if (lowLatencyAudio && length > 0 && size_t(length) < sizeof(title)) {
+                    std::snprintf(title + length, sizeof(title) - length, " - %llu audio underruns",
+                                  (unsigned long long)audio.getUnderruns());
+                }
+                window.setTitle(title);
+                titleAccumulator = 0;
+            }
 
-        if (chip8.isHalted()) {
-            quit = true;
+            if (frame.halted) {
+                quit = true;
+            }
         }
 
-        if (chip8.displayBufferUpdated && displayAccumulator >= DISPLAY_DRAW_DURATION) {
-            window.draw(chip8.getDisplayBuffer());
-            chip8.displayBufferUpdated = false;
-            displayAccumulator = 0;
-        }
-        
-        audio.setIsBeeping(chip8.isBeeping());
+        window.draw(emulator->frames().front().display, dirtyRows);
+
+        pacer.wait();
+    }
+
+    emulator->stop();
+
+    const FramePacer::Stats pacing = emulator->pacingStats();
+    std::printf("%llu frames, %.2f ms mean, %.3f ms jitter, %.2f ms worst, %.1f%% host CPU\n",
+                (unsigned long long)pacing.frames, pacing.meanMs, pacing.jitterMs, pacing.maxMs, pacing.cpuPercent);
 
-        SDL_Delay(0);
+    if (lowLatencyAudio) {
+        std::printf("%llu audio underruns, %llu ticks dropped\n",
+                    (unsigned long long)audio.getUnderruns(), (unsigned long long)audio.getDropped());
     }
 
     SDL_Quit();
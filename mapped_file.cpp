@@ -0,0 +1,85 @@
+#include "mapped_file.h"
+
+#include <fstream>
+
+#if !defined(_WIN32)
+#define CHIP8_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+#ifdef CHIP8_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+
+    // An empty file has nothing to map.
+    length = size_t(info.st_size);
+    if (length == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (p == MAP_FAILED) {
+        length = 0;
+        return false;
+    }
+
+    data = static_cast<const uint8_t*>(p);
+    mapped = true;
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return false;
+    }
+
+    contents.resize(size_t(in.tellg()));
+    in.seekg(0, std::ios::beg);
+    in.read(reinterpret_cast<char*>(contents.data()), std::streamsize(contents.size()));
+    if (!in) {
+        contents.clear();
+        return false;
+    }
+
+    data = contents.data();
+    length = contents.size();
+#endif
+
+    return true;
+}
+
+std::span<const uint8_t> MappedFile::bytes() const {
+    return std::span<const uint8_t>(data, length);
+}
+
+void MappedFile::close() {
+#ifdef CHIP8_MMAP
+    if (mapped) {
+        munmap(const_cast<uint8_t*>(data), length);
+    }
+#endif
+
+    data = nullptr;
+    length = 0;
+    mapped = false;
+    contents.clear();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// A whole file, read-only, mapped into memory rather than read so it comes
+// straight from the page cache. Platforms without mmap read it in instead.
+class MappedFile {
+
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Returns false if the file cannot be opened or mapped.
+        bool open(const std::string& path);
+
+        std::span<const uint8_t> bytes() const;
+
+    private:
+        const uint8_t* data = nullptr;
+        size_t length = 0;
+        bool mapped = false;
+
+        std::vector<uint8_t> contents;
+
+        void close();
+};
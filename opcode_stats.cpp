@@ -0,0 +1,65 @@
+#include "opcode_stats.h"
+#include "chip8.h"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+void OpcodeStats::merge(const OpcodeStats& other) {
+    for (size_t h = 0; h < MAX_HANDLERS; ++h) {
+        count[h] += other.count[h];
+        ticks[h] += other.ticks[h];
+
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            histogram[h][b] += other.histogram[h][b];
+        }
+    }
+
+    for (size_t t = 0; t < TABLE_COUNT; ++t) {
+        lookups[t] += other.lookups[t];
+    }
+}
+
+void OpcodeStats::write(std::FILE* out) const {
+    static constexpr const char* TABLE_NAMES[TABLE_COUNT] = { "MAIN_TABLE", "ARITH_TABLE", "F_TABLE", "unmatched" };
+
+    const uint64_t totalCount = std::accumulate(count.begin(), count.end(), uint64_t(0));
+    const uint64_t totalTicks = std::accumulate(ticks.begin(), ticks.end(), uint64_t(0));
+
+    std::vector<size_t> order;
+    for (size_t h = 0; h < MAX_HANDLERS; ++h) {
+        if (count[h] > 0) {
+            order.push_back(h);
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return ticks[a] > ticks[b]; });
+
+    std::fprintf(out, "%-10s %14s %7s %16s %7s %9s  histogram (log2 ticks: count)\n",
+                 "opcode", "count", "count%", "ticks", "ticks%", "avg");
+
+    for (size_t h : order) {
+        const char* name = Chip8::handlerName(h);
+
+        std::fprintf(out, "%-10s %14llu %6.2f%% %16llu %6.2f%% %9.1f ",
+                     name != nullptr ? name : "?",
+                     (unsigned long long)count[h], 100.0 * count[h] / totalCount,
+                     (unsigned long long)ticks[h], totalTicks > 0 ? 100.0 * ticks[h] / totalTicks : 0.0,
+                     double(ticks[h]) / count[h]);
+
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            if (histogram[h][b] > 0) {
+                std::fprintf(out, " %zu:%llu", b, (unsigned long long)histogram[h][b]);
+            }
+        }
+        std::fprintf(out, "\n");
+    }
+
+    std::fprintf(out, "%-10s %14llu %7s %16llu\n", "total",
+                 (unsigned long long)totalCount, "", (unsigned long long)totalTicks);
+
+    std::fprintf(out, "decode lookups:");
+    for (size_t t = 0; t < TABLE_COUNT; ++t) {
+        std::fprintf(out, " %s %llu", TABLE_NAMES[t], (unsigned long long)lookups[t]);
+    }
+    std::fprintf(out, "\n");
+}
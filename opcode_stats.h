@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Instruction counters for finding out which handlers a workload spends its
+// time in. Only built with -DCHIP8_OPCODE_STATS (make OPCODE_STATS=1); without
+// it Chip8 carries no counters and dispatch is untouched.
+//
+// Times are in TSC ticks where there is a TSC and nanoseconds elsewhere. Each
+// handler also gets a histogram of single-instruction times, bucketed by
+// powers of two, which shows whether an expensive average comes from every
+// call or from a few slow ones.
+struct OpcodeStats {
+    static constexpr size_t MAX_HANDLERS = 64;
+    static constexpr size_t BUCKETS = 24;
+
+    // The dispatch table lookups made while decoding, by the OpEntry table
+    // that matched.
+    enum Table { MAIN, ARITH, F, UNMATCHED, TABLE_COUNT };
+
+    std::array<uint64_t, MAX_HANDLERS> count{};
+    std::array<uint64_t, MAX_HANDLERS> ticks{};
+    std::array<std::array<uint64_t, BUCKETS>, MAX_HANDLERS> histogram{};
+    std::array<uint64_t, TABLE_COUNT> lookups{};
+
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    void record(size_t handler, uint64_t elapsed) {
+        // Bucket b holds times in [2^(b-1), 2^b).
+        const size_t bucket = std::min<size_t>(std::bit_width(elapsed), BUCKETS - 1);
+
+        count[handler]++;
+        ticks[handler] += elapsed;
+        histogram[handler][bucket]++;
+    }
+
+    void merge(const OpcodeStats& other);
+
+    // Writes a table sorted by total time, most expensive first.
+    void write(std::FILE* out) const;
+};
@@ -0,0 +1,113 @@
+#include "profiler.h"
+#include "chip8.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+Profiler::Profiler(size_t memorySize)
+    : paths{Path{0, UNKNOWN_ENTRY}},
+      addressCounts(memorySize, 0),
+      opcodes(memorySize, 0) {
+}
+
+void Profiler::count(const Chip8& chip8) {
+    const size_t sp = std::min<size_t>(chip8.SP, returns.size());
+    if (sp != depth || (depth > 0 && chip8.stack[depth - 1] != returns[depth - 1])) {
+        sync(chip8);
+    }
+
+    const uint16_t pc = chip8.PC & chip8.addressMask;
+    const uint16_t op = uint16_t(chip8.memory[pc] << 8 | chip8.memory[(pc + 1) & chip8.addressMask]);
+
+    addressCounts[pc]++;
+    opcodes[pc] = op;
+    counts[uint64_t(pathAt[depth]) << 16 | pc]++;
+    instructions++;
+}
+
+uint64_t Profiler::total() const {
+    return instructions;
+}
+
+// Keeps the frames still on the guest stack and rebuilds the rest from the
+// calls their return addresses point after.
+void Profiler::sync(const Chip8& chip8) {
+    const size_t sp = std::min<size_t>(chip8.SP, returns.size());
+
+    size_t kept = 0;
+    while (kept < depth && kept < sp && returns[kept] == chip8.stack[kept]) {
+        kept++;
+    }
+
+    for (depth = kept; depth < sp; ++depth) {
+        const uint16_t ret = chip8.stack[depth];
+        const uint16_t call = (ret - 2) & chip8.addressMask;
+        const uint16_t op = uint16_t(chip8.memory[call] << 8 | chip8.memory[(call + 1) & chip8.addressMask]);
+
+        returns[depth] = ret;
+        pathAt[depth + 1] = child(pathAt[depth], (op & 0xF000) == 0x2000 ? op & 0x0FFF : UNKNOWN_ENTRY);
+    }
+}
+
+uint32_t Profiler::child(uint32_t parent, uint16_t entry) {
+    const uint64_t key = uint64_t(parent) << 16 | entry;
+
+    auto [it, inserted] = children.try_emplace(key, uint32_t(paths.size()));
+    if (inserted) {
+        paths.push_back(Path{parent, entry});
+    }
+
+    return it->second;
+}
+
+void Profiler::writeStacks(std::FILE* out) const {
+    // Parents are always added before their children.
+    std::vector<std::string> names(paths.size());
+    names[0] = "main";
+    for (size_t i = 1; i < paths.size(); ++i) {
+        char frame[16];
+        if (paths[i].entry == UNKNOWN_ENTRY) {
+            std::snprintf(frame, sizeof(frame), "sub_?");
+        } else {
+            std::snprintf(frame, sizeof(frame), "sub_%04X", paths[i].entry);
+        }
+        names[i] = names[paths[i].parent] + ";" + frame;
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> lines(counts.begin(), counts.end());
+    std::sort(lines.begin(), lines.end());
+
+    for (const auto& [key, count] : lines) {
+        const uint16_t addr = uint16_t(key & 0xFFFF);
+
+        std::fprintf(out, "%s;%04X %s %llu\n", names[key >> 16].c_str(), addr,
+                     Chip8::disassemble(opcodes[addr]).c_str(), (unsigned long long)count);
+    }
+}
+
+void Profiler::writeHotList(std::FILE* out, size_t limit) const {
+    std::vector<uint16_t> order;
+    for (size_t addr = 0; addr < addressCounts.size(); ++addr) {
+        if (addressCounts[addr] > 0) {
+            order.push_back(uint16_t(addr));
+        }
+    }
+
+    limit = std::min(limit, order.size());
+    std::partial_sort(order.begin(), order.begin() + limit, order.end(), [this](uint16_t a, uint16_t b) {
+        return addressCounts[a] != addressCounts[b] ? addressCounts[a] > addressCounts[b] : a < b;
+    });
+
+    std::fprintf(out, "%-7s %-6s %-20s %14s %7s\n", "address", "opcode", "instruction", "count", "count%");
+
+    for (size_t i = 0; i < limit; ++i) {
+        const uint16_t addr = order[i];
+
+        std::fprintf(out, "%-7.4X %-6.4X %-20s %14llu %6.2f%%\n", addr, opcodes[addr],
+                     Chip8::disassemble(opcodes[addr]).c_str(),
+                     (unsigned long long)addressCounts[addr], 100.0 * addressCounts[addr] / instructions);
+    }
+
+    std::fprintf(out, "%-36s %14llu\n", "total", (unsigned long long)instructions);
+}
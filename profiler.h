@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+class Chip8;
+
+// Counts the instructions a ROM runs by guest address and call path, to find
+// out where a slow ROM spends its cycles. While a Chip8 has one, run() hands
+// it every instruction before running it on the interpreter, so the counts
+// are exact rather than sampled; without one, nothing in the core changes.
+//
+// Call paths follow the guest's 2nnn/00EE stack. A frame is named after the
+// subroutine called by the 2nnn just before its return address, so the
+// stack is rebuilt correctly after a rewind or savestate load as well.
+class Profiler {
+
+    public:
+        explicit Profiler(size_t memorySize);
+
+        // Counts the instruction at PC against the current call path.
+        void count(const Chip8& chip8);
+
+        uint64_t total() const;
+
+        // One line per call path and address, in the collapsed-stack format
+        // that flamegraph.pl, inferno and speedscope read:
+        //   main;sub_0300;0304 DRW V0, V1, 5 1234
+        void writeStacks(std::FILE* out) const;
+        // The most run addresses, most run first, with their disassembly.
+        void writeHotList(std::FILE* out, size_t limit) const;
+
+    private:
+        // Frames whose caller cannot be told from memory, e.g. after the
+        // code that called them was overwritten.
+        static constexpr uint16_t UNKNOWN_ENTRY = 0xFFFF;
+
+        struct Path {
+            uint32_t parent;
+            uint16_t entry;
+        };
+
+        // Path 0 is main, the code outside any subroutine.
+        std::vector<Path> paths;
+        std::unordered_map<uint64_t, uint32_t> children;
+
+        // The guest stack as last seen, and the path at each depth.
+        std::array<uint16_t, 16> returns{};
+        std::array<uint32_t, 17> pathAt{};
+        size_t depth = 0;
+
+        // Keyed by path << 16 | address.
+        std::unordered_map<uint64_t, uint64_t> counts;
+        std::vector<uint64_t> addressCounts;
+        // The opcode last run at each address.
+        std::vector<uint16_t> opcodes;
+        uint64_t instructions = 0;
+
+        void sync(const Chip8& chip8);
+        uint32_t child(uint32_t parent, uint16_t entry);
+};
@@ -0,0 +1,184 @@
+#include "rewind.h"
+
+#include <algorithm>
+#include <cstring>
+
+static void putVarint(std::vector<uint8_t>& out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+
+    out.push_back(uint8_t(value));
+}
+
+static size_t getVarint(const uint8_t*& p) {
+    size_t value = 0;
+    int shift = 0;
+
+    while (*p & 0x80) {
+        value |= size_t(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+
+    return value | (size_t(*p++) << shift);
+}
+
+Rewind::Rewind(size_t capacity) : ring(capacity) {
+}
+
+void Rewind::capture(const Chip8& chip8) {
+    chip8.saveState(state);
+
+    if (current.empty()) {
+        encoded.reserve(state.size() * 2);
+        current.swap(state);
+        return;
+    }
+
+    encode(current, state);
+    push();
+    current.swap(state);
+
+    lastBytes = encoded.size();
+    capturedFrames++;
+    capturedBytes += encoded.size();
+}
+
+bool Rewind::step(Chip8& chip8) {
+    if (entries.empty()) {
+        return false;
+    }
+
+    pop();
+    apply();
+    chip8.loadState(current);
+
+    return true;
+}
+
+void Rewind::clear() {
+    head = 0;
+    used = 0;
+    entries.clear();
+    current.clear();
+}
+
+size_t Rewind::frames() const {
+    return entries.size();
+}
+
+size_t Rewind::bytesUsed() const {
+    return used;
+}
+
+size_t Rewind::capacity() const {
+    return ring.size();
+}
+
+size_t Rewind::lastFrameBytes() const {
+    return lastBytes;
+}
+
+double Rewind::averageFrameBytes() const {
+    return capturedFrames > 0 ? double(capturedBytes) / double(capturedFrames) : 0;
+}
+
+// The XOR of two states is a list of (zero run, literal run, literals), with
+// lengths as varints. A literal run only ends at two zero bytes in a row, as
+// a single zero costs more to split on than to copy.
+void Rewind::encode(const std::vector<uint8_t>& from, const std::vector<uint8_t>& to) {
+    const size_t size = from.size();
+    const uint8_t* a = from.data();
+    const uint8_t* b = to.data();
+
+    encoded.clear();
+
+    size_t i = 0;
+    while (i < size) {
+        const size_t zeroStart = i;
+
+        // Most of a state is unchanged, so skip it a word at a time.
+        while (i + 8 <= size) {
+            uint64_t x, y;
+            std::memcpy(&x, a + i, 8);
+            std::memcpy(&y, b + i, 8);
+            if (x != y) {
+                break;
+            }
+            i += 8;
+        }
+
+        while (i < size && a[i] == b[i]) {
+            i++;
+        }
+
+        if (i == size) {
+            break;
+        }
+
+        const size_t literalStart = i;
+        while (i < size && !(a[i] == b[i] && (i + 1 == size || a[i + 1] == b[i + 1]))) {
+            i++;
+        }
+
+        putVarint(encoded, literalStart - zeroStart);
+        putVarint(encoded, i - literalStart);
+        for (size_t j = literalStart; j < i; ++j) {
+            encoded.push_back(a[j] ^ b[j]);
+        }
+    }
+}
+
+void Rewind::apply() {
+    const uint8_t* p = encoded.data();
+    const uint8_t* end = p + encoded.size();
+    size_t offset = 0;
+
+    while (p < end) {
+        offset += getVarint(p);
+
+        const size_t literals = getVarint(p);
+        for (size_t j = 0; j < literals; ++j) {
+            current[offset++] ^= *p++;
+        }
+    }
+}
+
+void Rewind::push() {
+    const size_t size = encoded.size();
+    const size_t cap = ring.size();
+
+    if (size > cap) {
+        clear();
+        return;
+    }
+
+    while (used + size > cap) {
+        used -= entries.front();
+        entries.pop_front();
+    }
+
+    const size_t first = std::min(size, cap - head);
+    std::memcpy(ring.data() + head, encoded.data(), first);
+    std::memcpy(ring.data(), encoded.data() + first, size - first);
+
+    head = (head + size) % cap;
+    used += size;
+    entries.push_back(uint32_t(size));
+}
+
+void Rewind::pop() {
+    const size_t size = entries.back();
+    const size_t cap = ring.size();
+
+    entries.pop_back();
+    head = (head + cap - size) % cap;
+    used -= size;
+
+    encoded.resize(size);
+
+    const size_t first = std::min(size, cap - head);
+    std::memcpy(encoded.data(), ring.data() + head, first);
+    std::memcpy(encoded.data() + first, ring.data(), size - first);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "chip8.h"
+
+// Rewind history, one entry per captured frame. Each entry is the XOR of a
+// savestate with the one captured before it, run-length encoded, so a frame
+// that only touches a few registers and framebuffer rows costs tens of bytes.
+// Because XOR is its own inverse, stepping back is just decoding the newest
+// entry over the current state; no keyframes are needed.
+//
+// Entries live back to back in a fixed-size ring. Once it is full the oldest
+// frames are dropped to make room.
+class Rewind {
+
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 4 * 1024 * 1024;
+
+        explicit Rewind(size_t capacity = DEFAULT_CAPACITY);
+
+        // Records the state chip8 is in now. Call once per frame.
+        void capture(const Chip8& chip8);
+
+        // Puts chip8 back to the previously captured frame. Returns false
+        // when there is no more history.
+        bool step(Chip8& chip8);
+
+        void clear();
+
+        size_t frames() const;
+        size_t bytesUsed() const;
+        size_t capacity() const;
+        size_t lastFrameBytes() const;
+        double averageFrameBytes() const;
+
+    private:
+        std::vector<uint8_t> ring;
+        size_t head = 0;
+        size_t used = 0;
+        std::deque<uint32_t> entries;
+
+        // The most recently captured state, which the newest entry leads to.
+        std::vector<uint8_t> current;
+        std::vector<uint8_t> state;
+        std::vector<uint8_t> encoded;
+
+        size_t lastBytes = 0;
+        uint64_t capturedFrames = 0;
+        uint64_t capturedBytes = 0;
+
+        void encode(const std::vector<uint8_t>& from, const std::vector<uint8_t>& to);
+        void apply();
+        void push();
+        void pop();
+};
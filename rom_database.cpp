@@ -0,0 +1,146 @@
+#include "rom_database.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+static constexpr char DATABASE_MAGIC[4] = {'C', '8', 'D', 'B'};
+static constexpr uint16_t DATABASE_VERSION = 1;
+
+static void putLE(std::ofstream& out, uint64_t value, int bytes) {
+    for (int b = 0; b < bytes; ++b) {
+        out.put(char(uint8_t(value >> (8 * b))));
+    }
+}
+
+static uint64_t getLE(const uint8_t* p, int bytes) {
+    uint64_t value = 0;
+    for (int b = 0; b < bytes; ++b) {
+        value |= uint64_t(p[b]) << (8 * b);
+    }
+    return value;
+}
+
+uint64_t RomDatabase::fingerprint(std::span<const uint8_t> rom) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (uint8_t byte : rom) {
+        hash ^= byte;
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+void RomDatabase::write(const std::string& path, std::vector<Entry> entries) {
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.hash < b.hash;
+    });
+
+    const auto duplicate = std::adjacent_find(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.hash == b.hash;
+    });
+    if (duplicate != entries.end()) {
+        char message[64];
+        std::snprintf(message, sizeof(message), "ROM %016llx is listed twice", (unsigned long long)duplicate->hash);
+        throw std::runtime_error(message);
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Unable to create ROM database");
+    }
+
+    out.write(DATABASE_MAGIC, sizeof(DATABASE_MAGIC));
+    putLE(out, DATABASE_VERSION, 2);
+    putLE(out, 0, 2);
+    putLE(out, entries.size(), 4);
+    putLE(out, 0, 4);
+
+    // Each entry is the hash, mode, quirk bits, two reserved bytes and the
+    // cycles per frame, little-endian.
+    for (const Entry& entry : entries) {
+        putLE(out, entry.hash, 8);
+        putLE(out, uint8_t(entry.profile.mode), 1);
+        putLE(out, quirkBits(entry.profile.quirks), 1);
+        putLE(out, 0, 2);
+        putLE(out, entry.profile.cyclesPerFrame, 4);
+    }
+
+    if (!out) {
+        throw std::runtime_error("Unable to write ROM database");
+    }
+}
+
+std::string RomDatabase::defaultPath(const char* argv0) {
+    return (std::filesystem::path(argv0).parent_path() / "roms.db").string();
+}
+
+RomDatabase::RomDatabase(const std::string& path) {
+    if (!file.open(path)) {
+        throw std::runtime_error("Unable to open ROM database");
+    }
+
+    const std::span<const uint8_t> bytes = file.bytes();
+    if (bytes.size() < HEADER_SIZE || std::memcmp(bytes.data(), DATABASE_MAGIC, sizeof(DATABASE_MAGIC)) != 0
+        || getLE(bytes.data() + 4, 2) != DATABASE_VERSION) {
+        throw std::runtime_error("Not a ROM database");
+    }
+
+    count = getLE(bytes.data() + 8, 4);
+
+    if (bytes.size() < HEADER_SIZE + count * ENTRY_SIZE) {
+        throw std::runtime_error("Truncated ROM database");
+    }
+}
+
+size_t RomDatabase::size() const {
+    return count;
+}
+
+RomDatabase::Entry RomDatabase::get(size_t index) const {
+    if (index >= count) {
+        throw std::out_of_range("ROM database index out of range");
+    }
+
+    const uint8_t* p = file.bytes().data() + HEADER_SIZE + index * ENTRY_SIZE;
+    if (p[8] > Mode::XO_CHIP) {
+        throw std::runtime_error("Unknown mode in ROM database");
+    }
+
+    return Entry {
+        .hash = getLE(p, 8),
+        .profile = {
+            .mode = Mode(p[8]),
+            .quirks = quirksFromBits(p[9]),
+            .cyclesPerFrame = uint32_t(getLE(p + 12, 4)),
+        },
+    };
+}
+
+std::optional<RomDatabase::Profile> RomDatabase::find(uint64_t hash) const {
+    const uint8_t* entries = file.bytes().data() + HEADER_SIZE;
+    size_t low = 0;
+    size_t high = count;
+
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (getLE(entries + mid * ENTRY_SIZE, 8) < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    const uint8_t* p = entries + low * ENTRY_SIZE;
+
+    // A mode this build does not know is as good as no entry.
+    if (low == count || getLE(p, 8) != hash || p[8] > Mode::XO_CHIP) {
+        return std::nullopt;
+    }
+
+    return get(low).profile;
+}
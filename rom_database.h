@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "settings.h"
+#include "mapped_file.h"
+
+// Known ROMs and the settings they run best with, keyed by a hash of the ROM
+// image. The file is a 16-byte header (magic, version and entry count)
+// followed by 16-byte entries sorted by hash, so it is mapped rather than
+// read and binary searched in place: a lookup touches a handful of pages
+// however many ROMs it holds.
+class RomDatabase {
+
+    public:
+        struct Profile {
+            Mode mode;
+            Quirks quirks;
+            // 0 leaves the mode's default speed.
+            uint32_t cyclesPerFrame;
+        };
+
+        struct Entry {
+            uint64_t hash;
+            Profile profile;
+        };
+
+        // FNV-1a over the ROM image.
+        static uint64_t fingerprint(std::span<const uint8_t> rom);
+
+        // Sorts the entries by hash. Throws std::runtime_error if two share
+        // a hash or the file cannot be written.
+        static void write(const std::string& path, std::vector<Entry> entries);
+
+        // roms.db next to the executable, where `make` puts it.
+        static std::string defaultPath(const char* argv0);
+
+        // Throws std::runtime_error if the file is missing or not a database.
+        explicit RomDatabase(const std::string& path);
+        RomDatabase(const RomDatabase&) = delete;
+        RomDatabase& operator=(const RomDatabase&) = delete;
+
+        size_t size() const;
+        Entry get(size_t index) const;
+        std::optional<Profile> find(uint64_t hash) const;
+
+    private:
+        static constexpr size_t HEADER_SIZE = 16;
+        static constexpr size_t ENTRY_SIZE = 16;
+
+        MappedFile file;
+        size_t count = 0;
+};
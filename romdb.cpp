@@ -0,0 +1,181 @@
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "arg_parser.h"
+#include "mapped_file.h"
+#include "rom_database.h"
+
+// Builds ROM databases and looks ROMs up in them.
+//
+// A list has one ROM per line: its path (relative to the list) or its
+// 16-digit fingerprint, then the emulator options it wants. Only --mode, the
+// quirk toggles and --cpf mean anything here; '#' starts a comment.
+//
+//   games/invaders.ch8 --mode=superchip --shift=false   # Space Invaders
+//   1a2b3c4d5e6f7081 --mode=xochip --cpf=200000
+
+static const char* modeName(Mode mode) {
+    switch (mode) {
+        case Mode::SUPER_CHIP: return "superchip";
+        case Mode::XO_CHIP: return "xochip";
+        default: return "chip8";
+    }
+}
+
+static bool parseFingerprint(const std::string& token, uint64_t& hash) {
+    if (token.size() != 16 || token.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+        return false;
+    }
+
+    hash = std::stoull(token, nullptr, 16);
+
+    return true;
+}
+
+// Appends the list's entries, or returns false after saying which line was
+// wrong.
+static bool readList(const std::string& path, std::vector<RomDatabase::Entry>& entries) {
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "Unable to open %s\n", path.c_str());
+        return false;
+    }
+
+    const std::filesystem::path base = std::filesystem::path(path).parent_path();
+    std::string line;
+
+    for (int number = 1; std::getline(in, line); ++number) {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream words(line);
+        std::vector<std::string> tokens;
+        for (std::string word; words >> word;) {
+            tokens.push_back(word);
+        }
+
+        if (tokens.empty()) {
+            continue;
+        }
+
+        uint64_t hash = 0;
+        if (!parseFingerprint(tokens[0], hash)) {
+            MappedFile rom;
+            if (!rom.open((base / tokens[0]).string())) {
+                std::fprintf(stderr, "%s:%d: unable to open %s\n", path.c_str(), number, tokens[0].c_str());
+                return false;
+            }
+
+            hash = RomDatabase::fingerprint(rom.bytes());
+        }
+
+        // The options go through the emulator's own parser, so they mean
+        // exactly what they would on its command line.
+        std::vector<char*> argv = { const_cast<char*>("chip8-romdb") };
+        bool cpf = false;
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            argv.push_back(tokens[i].data());
+            cpf |= tokens[i].rfind("--cpf=", 0) == 0;
+        }
+
+        const Settings settings = ArgParser::parse(int(argv.size()), argv.data(), std::nullopt);
+
+        entries.push_back(RomDatabase::Entry {
+            .hash = hash,
+            .profile = {
+                .mode = settings.mode,
+                .quirks = settings.quirks,
+                .cyclesPerFrame = cpf ? settings.cyclesPerSecond / 60 : 0,
+            },
+        });
+    }
+
+    return true;
+}
+
+// Prints a ROM in list form, with its profile's options if the database
+// has one, so the output can start or extend a list.
+static void printLookup(const std::string& path, const RomDatabase* database) {
+    MappedFile rom;
+    if (!rom.open(path)) {
+        std::fprintf(stderr, "Unable to open %s\n", path.c_str());
+        return;
+    }
+
+    const uint64_t hash = RomDatabase::fingerprint(rom.bytes());
+    std::printf("%016llx", (unsigned long long)hash);
+
+    if (std::optional<RomDatabase::Profile> profile = database ? database->find(hash) : std::nullopt) {
+        const Quirks& q = profile->quirks;
+        std::printf(" --mode=%s --vfreset=%d --memory=%d --clipping=%d --shift=%d --jump=%d --press=%d",
+                    modeName(profile->mode), q.vfReset, q.memory, q.clipping, q.shift, q.jump, q.press);
+
+        if (profile->cyclesPerFrame > 0) {
+            std::printf(" --cpf=%u", profile->cyclesPerFrame);
+        }
+    }
+
+    std::printf("  # %s\n", path.c_str());
+}
+
+int main(int argc, char* argv[]) {
+    std::string output;
+    std::string databasePath = RomDatabase::defaultPath(argv[0]);
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        if (arg.rfind("--output=", 0) == 0) {
+            output = arg.substr(9);
+        } else if (arg.rfind("--romdb=", 0) == 0) {
+            databasePath = arg.substr(8);
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+
+    if (inputs.empty()) {
+        std::fprintf(stderr, "usage: chip8-romdb --output=FILE <list>...\n"
+                             "       chip8-romdb [--romdb=FILE] <rom>...\n");
+        return 1;
+    }
+
+    if (!output.empty()) {
+        std::vector<RomDatabase::Entry> entries;
+        for (const std::string& list : inputs) {
+            if (!readList(list, entries)) {
+                return 1;
+            }
+        }
+
+        try {
+            RomDatabase::write(output, std::move(entries));
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "%s\n", e.what());
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // Without a database the fingerprints are still worth printing.
+    std::unique_ptr<RomDatabase> database;
+    try {
+        database = std::make_unique<RomDatabase>(databasePath);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+    }
+
+    for (const std::string& rom : inputs) {
+        printLookup(rom, database.get());
+    }
+
+    return 0;
+}
@@ -1,20 +1,94 @@
 #pragma once
 
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
 
 enum Mode {
     CHIP_8,
     SUPER_CHIP,
+    XO_CHIP,
 };
 
-struct Settings {
-    Mode mode;
-    std::string rom;
-    
+enum Cpu {
+    INTERPRETER,
+    THREADED,
+    JIT,
+    AOT,
+};
+
+struct Quirks {
     bool vfReset;
     bool memory;
     bool clipping;
     bool shift;
     bool jump;
     bool press;
+};
+
+inline constexpr Quirks CHIP_8_QUIRKS {
+    .vfReset = true,
+    .memory = true,
+    .clipping = true,
+    .shift = false,
+    .jump = false,
+    .press = true,
+};
+
+inline constexpr Quirks SUPER_CHIP_QUIRKS {
+    .vfReset = false,
+    .memory = false,
+    .clipping = true,
+    .shift = true,
+    .jump = true,
+    .press = true,
+};
+
+// As Octo runs XO-CHIP: sprites wrap at the edges.
+inline constexpr Quirks XO_CHIP_QUIRKS {
+    .vfReset = false,
+    .memory = true,
+    .clipping = false,
+    .shift = false,
+    .jump = false,
+    .press = true,
+};
+
+// Packs a quirk profile into 6 bits so every combination can be enumerated.
+inline constexpr size_t QUIRK_COMBINATIONS = 64;
+
+constexpr size_t quirkBits(const Quirks& q) {
+    return size_t(q.vfReset) | size_t(q.memory) << 1 | size_t(q.clipping) << 2
+         | size_t(q.shift) << 3 | size_t(q.jump) << 4 | size_t(q.press) << 5;
+}
+
+constexpr Quirks quirksFromBits(size_t bits) {
+    return Quirks {
+        .vfReset = bool(bits & 1),
+        .memory = bool(bits & 2),
+        .clipping = bool(bits & 4),
+        .shift = bool(bits & 8),
+        .jump = bool(bits & 16),
+        .press = bool(bits & 32),
+    };
+}
+
+struct Settings {
+    Mode mode;
+    Cpu cpu;
+    std::string rom;
+
+    Quirks quirks;
+
+    // Seeds Cxkk's RNG. Left empty, every run gets a fresh seed.
+    std::optional<uint32_t> seed;
+
+    // Instructions per second of emulated time. --cpf=N sets it to N per
+    // 60 Hz frame. XO-CHIP defaults to 1000 per frame, as in Octo.
+    uint32_t cyclesPerSecond = 500;
+
+    // How fast emulated time runs against real time in the window, timers
+    // included. Headless runners ignore it.
+    double speed = 1.0;
 };
\ No newline at end of file
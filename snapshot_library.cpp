@@ -0,0 +1,86 @@
+#include "snapshot_library.h"
+#include "chip8.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static constexpr char LIBRARY_MAGIC[4] = {'C', '8', 'S', 'L'};
+static constexpr uint16_t LIBRARY_VERSION = 1;
+
+static void putLE(std::ofstream& out, uint32_t value, int bytes) {
+    for (int b = 0; b < bytes; ++b) {
+        out.put(char(uint8_t(value >> (8 * b))));
+    }
+}
+
+static bool isStateSize(size_t size) {
+    return size == stateSize(Mode::CHIP_8) || size == stateSize(Mode::XO_CHIP);
+}
+
+static uint32_t getLE(const uint8_t* p, int bytes) {
+    uint32_t value = 0;
+    for (int b = 0; b < bytes; ++b) {
+        value |= uint32_t(p[b]) << (8 * b);
+    }
+    return value;
+}
+
+void SnapshotLibrary::write(const std::string& path, std::span<const std::vector<uint8_t>> states) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Unable to create snapshot library");
+    }
+
+    // Every state comes from the same mode, so they share one size.
+    const size_t size = states.empty() ? ::stateSize(Mode::CHIP_8) : states.front().size();
+
+    out.write(LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC));
+    putLE(out, LIBRARY_VERSION, 2);
+    putLE(out, 0, 2);
+    putLE(out, uint32_t(states.size()), 4);
+    putLE(out, uint32_t(size), 4);
+
+    for (const auto& state : states) {
+        if (state.size() != size || !isStateSize(size)) {
+            throw std::runtime_error("Not a savestate");
+        }
+
+        out.write(reinterpret_cast<const char*>(state.data()), std::streamsize(state.size()));
+    }
+
+    if (!out) {
+        throw std::runtime_error("Unable to write snapshot library");
+    }
+}
+
+SnapshotLibrary::SnapshotLibrary(const std::string& path) {
+    if (!file.open(path)) {
+        throw std::runtime_error("Unable to open snapshot library");
+    }
+
+    const std::span<const uint8_t> bytes = file.bytes();
+    if (bytes.size() < HEADER_SIZE || std::memcmp(bytes.data(), LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC)) != 0
+        || getLE(bytes.data() + 4, 2) != LIBRARY_VERSION) {
+        throw std::runtime_error("Not a snapshot library");
+    }
+
+    count = getLE(bytes.data() + 8, 4);
+    stateSize = getLE(bytes.data() + 12, 4);
+
+    if (!isStateSize(stateSize) || bytes.size() < HEADER_SIZE + count * stateSize) {
+        throw std::runtime_error("Truncated snapshot library");
+    }
+}
+
+size_t SnapshotLibrary::size() const {
+    return count;
+}
+
+std::span<const uint8_t> SnapshotLibrary::get(size_t index) const {
+    if (index >= count) {
+        throw std::out_of_range("Snapshot index out of range");
+    }
+
+    return file.bytes().subspan(HEADER_SIZE + index * stateSize, stateSize);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// A file of savestates that is mapped into memory rather than read, so
+// thousands of runs can be reset to a saved point straight from the page
+// cache. The file is a 16-byte header (magic, version, state count and
+// state size) followed by the states back to back.
+class SnapshotLibrary {
+
+    public:
+        static void write(const std::string& path, std::span<const std::vector<uint8_t>> states);
+
+        explicit SnapshotLibrary(const std::string& path);
+        SnapshotLibrary(const SnapshotLibrary&) = delete;
+        SnapshotLibrary& operator=(const SnapshotLibrary&) = delete;
+
+        size_t size() const;
+        std::span<const uint8_t> get(size_t index) const;
+
+    private:
+        static constexpr size_t HEADER_SIZE = 16;
+
+        MappedFile file;
+        size_t count = 0;
+        size_t stateSize = 0;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// What the sound hardware is playing. CHIP-8 and SUPER-CHIP only have a
+// buzzer; XO-CHIP instead loops a pattern of 128 one-bit samples, at a rate
+// set by its pitch register.
+struct Sound {
+    bool beeping = false;
+    bool pattern = false;
+    std::array<uint8_t, 16> samples{};
+    uint8_t pitch = 64;
+};
+
+// Pattern samples per second at a pitch: 4000 at the default of 64, and an
+// octave per 48 steps either side.
+inline double patternRate(uint8_t pitch) {
+    return 4000.0 * std::exp2((int(pitch) - 64) / 48.0);
+}
@@ -0,0 +1,296 @@
+#include "terminal.h"
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+// Indexed by (bottom pixel << 1 | top pixel).
+static const char* const GLYPHS[4] = { " ", "▀", "▄", "█" };
+
+// The keys for CHIP-8 keys 0x0 to 0xF, laid out as in the window.
+static const char KEYMAP[] = "x123qweasdzc4rfv";
+
+Terminal::~Terminal() {
+    if (!rawMode) {
+        return;
+    }
+
+    out = "\x1b[<u\x1b[0m\x1b[?25h\x1b[?1049l";
+    flush();
+
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &original);
+}
+
+int Terminal::init() {
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+        std::fprintf(stderr, "The terminal display needs a terminal on stdin and stdout\n");
+
+        return 1;
+    }
+
+    if (tcgetattr(STDIN_FILENO, &original) != 0) {
+        std::fprintf(stderr, "tcgetattr error\n");
+
+        return 1;
+    }
+
+    // No echo, no line buffering, no signals from Ctrl-C, and reads that
+    // return at once with whatever is there.
+    termios raw = original;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_oflag &= ~OPOST;
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) {
+        std::fprintf(stderr, "tcsetattr error\n");
+
+        return 1;
+    }
+    rawMode = true;
+
+    // Alternate screen, hidden cursor, kitty key events with releases,
+    // then the display colours.
+    char colours[64];
+    std::snprintf(colours, sizeof(colours), "\x1b[38;2;%d;%d;%dm\x1b[48;2;%d;%d;%dm",
+                  FOREGROUND_RGB[0], FOREGROUND_RGB[1], FOREGROUND_RGB[2],
+                  BACKGROUND_RGB[0], BACKGROUND_RGB[1], BACKGROUND_RGB[2]);
+
+    out = "\x1b[?1049h\x1b[?25l\x1b[>11u";
+    out += colours;
+    flush();
+
+    return 0;
+}
+
+Terminal::Input Terminal::poll() {
+    char data[256];
+    ssize_t count;
+    while ((count = read(STDIN_FILENO, data, sizeof(data))) > 0) {
+        parse(data, size_t(count));
+    }
+
+    const Clock::time_point now = Clock::now();
+    bool held[KEY_COUNT];
+    for (int key = 0; key < KEY_COUNT; ++key) {
+        held[key] = ((heldKeys >> key) & 1) || now - lastPress[key] < HOLD;
+    }
+
+    Input input{};
+    for (int key = 0; key < 16; ++key) {
+        input.keypad |= uint16_t(held[key]) << key;
+    }
+    input.rewind = held[REWIND_KEY];
+    input.turbo = held[TURBO_KEY];
+    input.quit = quitPressed;
+
+    return input;
+}
+
+// Plain bytes are key presses. Kitty key events arrive as
+// CSI code[:alternates] ; modifiers[:event] [; text] u, and any other
+// escape sequence is skipped.
+void Terminal::parse(const char* data, size_t size) {
+    pending.append(data, size);
+
+    size_t i = 0;
+    while (i < pending.size()) {
+        const uint8_t c = pending[i];
+
+        if (c != 0x1B) {
+            keyEvent(c, 1, 0);
+            i++;
+            continue;
+        }
+
+        // An escape with nothing after it is the Esc key itself.
+        if (i + 1 == pending.size()) {
+            quitPressed = true;
+            i++;
+            continue;
+        }
+
+        if (pending[i + 1] != '[') {
+            i++;
+            continue;
+        }
+
+        size_t end = i + 2;
+        while (end < pending.size() && (pending[end] < 0x40 || pending[end] > 0x7E)) {
+            end++;
+        }
+
+        // The rest of the sequence is still on its way.
+        if (end == pending.size()) {
+            break;
+        }
+
+        if (pending[end] == 'u') {
+            const char* p = pending.c_str() + i + 2;
+            char* next = nullptr;
+
+            const uint32_t code = std::strtoul(p, &next, 10);
+            uint32_t modifiers = 1;
+            int event = 1;
+
+            while (*next == ':' || (*next >= '0' && *next <= '9')) {
+                next++;
+            }
+            if (*next == ';') {
+                modifiers = std::strtoul(next + 1, &next, 10);
+                if (*next == ':') {
+                    event = int(std::strtoul(next + 1, &next, 10));
+                }
+            }
+
+            keyEvent(code, modifiers, event);
+        }
+
+        i = end + 1;
+    }
+
+    pending.erase(0, i);
+}
+
+// event is 1 for a press, 2 for a repeat and 3 for a release, or 0 for a
+// plain byte that only says the key went down.
+void Terminal::keyEvent(uint32_t code, uint32_t modifiers, int event) {
+    const bool ctrl = ((modifiers - 1) & 4) != 0;
+
+    if (event != 3 && (code == 27 || code == 3 || (ctrl && code == 'c'))) {
+        quitPressed = true;
+        return;
+    }
+
+    if (code >= 'A' && code <= 'Z') {
+        code += 'a' - 'A';
+    }
+
+    int key = -1;
+    if (code == 127 || code == 8) {
+        key = REWIND_KEY;
+    } else if (code == '\t') {
+        key = TURBO_KEY;
+    } else {
+        for (int k = 0; k < 16; ++k) {
+            if (code == uint32_t(KEYMAP[k])) {
+                key = k;
+            }
+        }
+    }
+
+    if (key < 0) {
+        return;
+    }
+
+    if (event == 0) {
+        lastPress[key] = Clock::now();
+    } else if (event == 3) {
+        heldKeys &= ~(1u << key);
+    } else {
+        heldKeys |= 1u << key;
+    }
+}
+
+void Terminal::draw(const DisplayBuffer& buffer, bool hires, const std::string& status) {
+    winsize size{};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && (size.ws_col != columns || size.ws_row != lines)) {
+        columns = size.ws_col;
+        lines = size.ws_row;
+        redraw = true;
+    }
+
+    if (hires != shownHires) {
+        shownHires = hires;
+        redraw = true;
+    }
+
+    out.clear();
+    if (redraw) {
+        out += "\x1b[2J";
+        shownStatus.clear();
+    }
+
+    // Anything that does not fit the terminal is cut off, keeping a line
+    // for the status.
+    const int width = std::min(displayWidth(hires), columns);
+    const int rows = std::min(displayHeight(hires) / 2, lines - 1);
+
+    int cursorRow = -1;
+    int cursorColumn = -1;
+    char move[32];
+
+    for (int row = 0; row < rows; ++row) {
+        const DisplayRow& top = buffer[2 * row];
+        const DisplayRow& bottom = buffer[2 * row + 1];
+
+        for (int word = 0; word * 64 < width; ++word) {
+            uint64_t changed = redraw ? ~uint64_t(0)
+                : (top[word] ^ shown[2 * row][word]) | (bottom[word] ^ shown[2 * row + 1][word]);
+
+            if (width - word * 64 < 64) {
+                changed &= ~(~uint64_t(0) >> (width - word * 64));
+            }
+
+            while (changed != 0) {
+                const int bit = std::countl_zero(changed);
+                changed &= ~(uint64_t(1) << (63 - bit));
+
+                const int column = word * 64 + bit;
+                if (row != cursorRow || column != cursorColumn) {
+                    std::snprintf(move, sizeof(move), "\x1b[%d;%dH", row + 1, column + 1);
+                    out += move;
+                }
+
+                const int cell = int((top[word] >> (63 - bit)) & 1) | int(((bottom[word] >> (63 - bit)) & 1) << 1);
+                out += GLYPHS[cell];
+
+                cursorRow = row;
+                cursorColumn = column + 1;
+            }
+        }
+    }
+
+    shown = buffer;
+    redraw = false;
+
+    if (status != shownStatus && rows < lines) {
+        std::snprintf(move, sizeof(move), "\x1b[%d;1H", rows + 1);
+        out += move;
+        out += status;
+        out += "\x1b[K";
+        shownStatus = status;
+    }
+
+    flush();
+}
+
+void Terminal::beep() {
+    out = "\a";
+    flush();
+}
+
+void Terminal::flush() {
+    const char* data = out.data();
+    size_t left = out.size();
+
+    while (left > 0) {
+        const ssize_t written = write(STDOUT_FILENO, data, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        data += written;
+        left -= size_t(written);
+    }
+}
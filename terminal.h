@@ -0,0 +1,77 @@
+#pragma once
+
+#include <termios.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "display_buffer.h"
+
+// A text-mode stand-in for Window and the keyboard, for running over SSH or
+// anywhere else without a display.
+//
+// Each character cell shows two pixel rows with the half-block glyphs, so
+// a hires screen needs 128x33 cells and a lores one 64x17. Each frame is
+// compared with the one on screen and only changed cells are sent, with a
+// cursor move wherever a run of them breaks. The frame goes out in a single
+// write().
+//
+// Input comes from stdin in raw mode. Plain terminals only send key presses
+// (and autorepeats), so a key counts as held for a short while after each
+// one; terminals that speak the kitty keyboard protocol also send releases,
+// and then keys are held exactly as long as they are down.
+class Terminal {
+
+    public:
+        struct Input {
+            uint16_t keypad;
+            bool rewind;
+            bool turbo;
+            bool quit;
+        };
+
+        ~Terminal();
+        int init();
+
+        // Reads everything waiting on stdin.
+        Input poll();
+
+        // status goes on the line below the display.
+        void draw(const DisplayBuffer& buffer, bool hires, const std::string& status);
+        void beep();
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        // How long a key stays down after a press when there are no
+        // release events.
+        static constexpr std::chrono::milliseconds HOLD{150};
+
+        // The 16 keypad keys, then rewind and turbo.
+        static constexpr int KEY_COUNT = 18;
+        static constexpr int REWIND_KEY = 16;
+        static constexpr int TURBO_KEY = 17;
+
+        termios original{};
+        bool rawMode = false;
+
+        std::array<Clock::time_point, KEY_COUNT> lastPress{};
+        uint32_t heldKeys = 0;
+        bool quitPressed = false;
+        // The start of an escape sequence split across reads.
+        std::string pending;
+
+        DisplayBuffer shown{};
+        bool shownHires = false;
+        bool redraw = true;
+        int columns = 0;
+        int lines = 0;
+        std::string shownStatus;
+        std::string out;
+
+        void parse(const char* data, size_t size);
+        void keyEvent(uint32_t code, uint32_t modifiers, int event);
+        void flush();
+};
@@ -0,0 +1,73 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <thread>
+
+ThreadPool::ThreadPool(size_t threads) {
+    threadCount = std::max<size_t>(threads, 1);
+
+    for (size_t i = 0; i < threadCount; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+}
+
+size_t ThreadPool::size() const {
+    return threadCount;
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& job) {
+    for (size_t i = 0; i < count; ++i) {
+        queues[i % threadCount]->jobs.push_back(i);
+    }
+
+    // The calling thread works too, as worker 0.
+    std::vector<std::thread> threads;
+    for (size_t worker = 1; worker < threadCount; ++worker) {
+        threads.emplace_back(&ThreadPool::work, this, worker, std::cref(job));
+    }
+
+    work(0, job);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool ThreadPool::take(size_t worker, size_t& job) {
+    Queue& queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.jobs.empty()) {
+        return false;
+    }
+
+    job = queue.jobs.back();
+    queue.jobs.pop_back();
+
+    return true;
+}
+
+bool ThreadPool::steal(size_t worker, size_t& job) {
+    for (size_t i = 1; i < threadCount; ++i) {
+        Queue& victim = *queues[(worker + i) % threadCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// No job creates more jobs, so once every queue is empty the worker is done.
+void ThreadPool::work(size_t worker, const std::function<void(size_t)>& job) {
+    size_t next = 0;
+
+    while (take(worker, next) || steal(worker, next)) {
+        job(next);
+    }
+}
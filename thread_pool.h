@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A fork/join pool for a fixed set of independent jobs. Jobs are dealt out
+// round-robin to per-worker queues; a worker takes from the back of its own
+// queue and, once that is empty, steals from the front of the others, so a
+// few slow jobs do not leave the rest of the cores idle.
+class ThreadPool {
+
+    public:
+        explicit ThreadPool(size_t threads);
+
+        // Calls job(i) for every i in [0, count) and returns once all are done.
+        void run(size_t count, const std::function<void(size_t)>& job);
+
+        size_t size() const;
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<size_t> jobs;
+        };
+
+        size_t threadCount;
+        std::vector<std::unique_ptr<Queue>> queues;
+
+        bool take(size_t worker, size_t& job);
+        bool steal(size_t worker, size_t& job);
+        void work(size_t worker, const std::function<void(size_t)>& job);
+};
@@ -0,0 +1,267 @@
+#include "threaded.h"
+
+#include <algorithm>
+
+#if defined(__GNUC__)
+#define CHIP8_COMPUTED_GOTO 1
+#else
+#define CHIP8_COMPUTED_GOTO 0
+#endif
+
+#if CHIP8_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#if defined(__clang__)
+#pragma GCC diagnostic ignored "-Wgnu-label-as-value"
+#elif __GNUC__ >= 12
+// Label addresses stay valid for the life of the program.
+#pragma GCC diagnostic ignored "-Wdangling-pointer"
+#endif
+#endif
+
+void ThreadedCode::invalidate(size_t first, size_t last) {
+    first = first > MAX_OP_BYTES - 2 ? first - (MAX_OP_BYTES - 2) : 0;
+    last = std::min(last, ops.size());
+
+    for (size_t i = first; i < last; ++i) {
+        ops[i].target = translateTarget;
+        ops[i].kind = TRANSLATE;
+    }
+}
+
+void ThreadedCode::reset() {
+    invalidate(0, ops.size());
+}
+
+void ThreadedCode::translate(const Chip8& chip8, uint16_t pc, const void* const* labels) {
+    auto fetch = [&chip8](size_t addr) -> uint16_t {
+        return uint16_t((chip8.memory[addr & 0x0FFF] << 8) | chip8.memory[(addr + 1) & 0x0FFF]);
+    };
+
+    const uint16_t raw = fetch(pc);
+    const uint16_t raw2 = fetch(pc + 2);
+
+    ThreadedOp& op = ops[pc];
+    op.d = decode(raw);
+    op.d2 = decode(raw2);
+    op.handler = Chip8::DISPATCH_TABLE[dispatchIndex(raw)];
+    op.handler2 = Chip8::DISPATCH_TABLE[dispatchIndex(raw2)];
+    op.kind = GENERIC;
+
+    const uint8_t group = raw >> 12;
+    const uint8_t group2 = raw2 >> 12;
+
+    if (group == 0x6 && group2 == 0x6) {
+        op.kind = LD_IMM_LD_IMM;
+    } else if (group == 0x7 && group2 == 0x3) {
+        op.kind = ADD_IMM_SE_IMM;
+    } else if (group == 0xA && group2 == 0xD) {
+        op.kind = LD_I_DRW;
+    } else if ((raw & 0xF0FF) == 0xF007 && group2 == 0x3) {
+        op.kind = LD_DT_SE_IMM;
+    } else if (group == 0x1) {
+        op.kind = JP;
+    } else if (group == 0x3) {
+        op.kind = SE_IMM;
+    } else if (group == 0x4) {
+        op.kind = SNE_IMM;
+    } else if ((raw & 0xF00F) == 0x5000) {
+        op.kind = SE_REG;
+    } else if ((raw & 0xF00F) == 0x9000) {
+        op.kind = SNE_REG;
+    } else if (group == 0x6) {
+        op.kind = LD_IMM;
+    } else if (group == 0x7) {
+        op.kind = ADD_IMM;
+    } else if ((raw & 0xF00F) == 0x8000) {
+        op.kind = LD_REG;
+    } else if (group == 0xA) {
+        op.kind = LD_I;
+    } else if ((raw & 0xF0FF) == 0xF01E) {
+        op.kind = ADD_I;
+    } else if ((raw & 0xF0FF) == 0xF007) {
+        op.kind = LD_DT;
+    }
+
+    op.target = labels ? labels[op.kind] : nullptr;
+}
+
+uint64_t ThreadedCode::run(Chip8& c, uint64_t budget) {
+    uint64_t executed = 0;
+    ThreadedOp* op = nullptr;
+    auto& V = c.V;
+
+#if CHIP8_COMPUTED_GOTO
+    static const void* const LABELS[KIND_COUNT] = {
+        &&L_TRANSLATE, &&L_GENERIC, &&L_JP, &&L_SE_IMM, &&L_SNE_IMM, &&L_SE_REG, &&L_SNE_REG,
+        &&L_LD_IMM, &&L_ADD_IMM, &&L_LD_REG, &&L_LD_I, &&L_ADD_I, &&L_LD_DT,
+        &&L_LD_IMM_LD_IMM, &&L_ADD_IMM_SE_IMM, &&L_LD_I_DRW, &&L_LD_DT_SE_IMM,
+    };
+
+    if (translateTarget == nullptr) {
+        translateTarget = LABELS[TRANSLATE];
+        reset();
+    }
+
+#define TARGET(kind) L_##kind
+#define DISPATCH() goto *op->target
+#else
+    static const void* const* const LABELS = nullptr;
+
+#define TARGET(kind) case kind
+#define DISPATCH() goto dispatch
+#endif
+
+// Advances past `count` instructions, then fetches and dispatches the next one.
+#define NEXT(count)                                 \
+    do {                                            \
+        executed += (count);                        \
+        if (executed >= budget) {                   \
+            return executed;                        \
+        }                                           \
+        op = &ops[c.PC & 0x0FFF];                   \
+        DISPATCH();                                 \
+    } while (0)
+
+// A superinstruction that would overrun the budget runs its first half only.
+#define SPLIT_IF_OUT_OF_BUDGET()                    \
+    do {                                            \
+        if (budget - executed < 2) {                \
+            goto single;                            \
+        }                                           \
+    } while (0)
+
+    if (budget == 0) {
+        return 0;
+    }
+
+    op = &ops[c.PC & 0x0FFF];
+    DISPATCH();
+
+#if !CHIP8_COMPUTED_GOTO
+dispatch:
+    switch (op->kind) {
+#endif
+
+    TARGET(TRANSLATE): {
+        translate(c, c.PC & 0x0FFF, LABELS);
+        DISPATCH();
+    }
+
+    TARGET(GENERIC): {
+        c.PC += 2;
+        (c.*c.handlers[op->handler])(op->d);
+        NEXT(1);
+    }
+
+    TARGET(JP): {
+        c.PC = op->d.nnn;
+        NEXT(1);
+    }
+
+    TARGET(SE_IMM): {
+        c.PC += (V[op->d.x] == op->d.nn) ? 4 : 2;
+        NEXT(1);
+    }
+
+    TARGET(SNE_IMM): {
+        c.PC += (V[op->d.x] != op->d.nn) ? 4 : 2;
+        NEXT(1);
+    }
+
+    TARGET(SE_REG): {
+        c.PC += (V[op->d.x] == V[op->d.y]) ? 4 : 2;
+        NEXT(1);
+    }
+
+    TARGET(SNE_REG): {
+        c.PC += (V[op->d.x] != V[op->d.y]) ? 4 : 2;
+        NEXT(1);
+    }
+
+    TARGET(LD_IMM): {
+        V[op->d.x] = op->d.nn;
+        c.PC += 2;
+        NEXT(1);
+    }
+
+    TARGET(ADD_IMM): {
+        V[op->d.x] = uint8_t(V[op->d.x] + op->d.nn);
+        c.PC += 2;
+        NEXT(1);
+    }
+
+    TARGET(LD_REG): {
+        V[op->d.x] = V[op->d.y];
+        c.PC += 2;
+        NEXT(1);
+    }
+
+    TARGET(LD_I): {
+        c.I = op->d.nnn;
+        c.PC += 2;
+        NEXT(1);
+    }
+
+    TARGET(ADD_I): {
+        c.I += V[op->d.x];
+        c.PC += 2;
+        NEXT(1);
+    }
+
+    TARGET(LD_DT): {
+        V[op->d.x] = c.delayTimer;
+        c.PC += 2;
+        NEXT(1);
+    }
+
+    TARGET(LD_IMM_LD_IMM): {
+        SPLIT_IF_OUT_OF_BUDGET();
+        V[op->d.x] = op->d.nn;
+        V[op->d2.x] = op->d2.nn;
+        c.PC += 4;
+        NEXT(2);
+    }
+
+    TARGET(ADD_IMM_SE_IMM): {
+        SPLIT_IF_OUT_OF_BUDGET();
+        V[op->d.x] = uint8_t(V[op->d.x] + op->d.nn);
+        c.PC += (V[op->d2.x] == op->d2.nn) ? 6 : 4;
+        NEXT(2);
+    }
+
+    TARGET(LD_I_DRW): {
+        SPLIT_IF_OUT_OF_BUDGET();
+        c.I = op->d.nnn;
+        c.PC += 4;
+        (c.*c.handlers[op->handler2])(op->d2);
+        NEXT(2);
+    }
+
+    TARGET(LD_DT_SE_IMM): {
+        SPLIT_IF_OUT_OF_BUDGET();
+        V[op->d.x] = c.delayTimer;
+        c.PC += (V[op->d2.x] == op->d2.nn) ? 6 : 4;
+        NEXT(2);
+    }
+
+#if !CHIP8_COMPUTED_GOTO
+        default:
+            break;
+    }
+#endif
+
+single:
+    c.PC += 2;
+    (c.*c.handlers[op->handler])(op->d);
+    NEXT(1);
+
+#undef SPLIT_IF_OUT_OF_BUDGET
+#undef NEXT
+#undef DISPATCH
+#undef TARGET
+}
+
+#if CHIP8_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "chip8.h"
+
+// Direct-threaded interpreter. Every address is translated on first use into
+// the address of the code that implements it plus its operands, and common
+// instruction pairs are fused into a single superinstruction. Uses computed
+// goto where the compiler supports it and a switch everywhere else.
+class ThreadedCode {
+
+    public:
+        // Executes up to budget instructions and returns how many ran.
+        uint64_t run(Chip8& chip8, uint64_t budget);
+        void invalidate(size_t first, size_t last);
+        void reset();
+
+    private:
+        enum Kind : uint8_t {
+            TRANSLATE,
+            GENERIC,
+            JP,
+            SE_IMM,
+            SNE_IMM,
+            SE_REG,
+            SNE_REG,
+            LD_IMM,
+            ADD_IMM,
+            LD_REG,
+            LD_I,
+            ADD_I,
+            LD_DT,
+            // Superinstructions: two instructions, counted as two.
+            LD_IMM_LD_IMM,
+            ADD_IMM_SE_IMM,
+            LD_I_DRW,
+            LD_DT_SE_IMM,
+            KIND_COUNT,
+        };
+
+        struct ThreadedOp {
+            const void* target;
+            Kind kind;
+            uint8_t handler;
+            uint8_t handler2;
+            Decoded d;
+            Decoded d2;
+        };
+
+        // A superinstruction starting up to three bytes before a write covers it.
+        static constexpr size_t MAX_OP_BYTES = 4;
+
+        std::array<ThreadedOp, 4096> ops{};
+        const void* translateTarget = nullptr;
+
+        void translate(const Chip8& chip8, uint16_t pc, const void* const* labels);
+};
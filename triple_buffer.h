@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Hands values from one writer thread to one reader thread without locks or
+// waiting. There are three slots: the writer fills one, the reader holds
+// another, and the third is the most recently published value. Publishing and
+// taking are a single atomic exchange of slot indices, so neither side ever
+// blocks the other, and the reader always gets the newest complete value
+// (values published between two reads are dropped).
+template <typename T>
+class TripleBuffer {
+
+    public:
+        // Writer side: fill back(), then publish() it.
+        T& back() {
+            return slots[write];
+        }
+
+        void publish() {
+            write = middle.exchange(uint8_t(write | FRESH), std::memory_order_acq_rel) & INDEX;
+        }
+
+        // Reader side: update() takes the newest value, if there is a new one,
+        // and front() is the value taken last.
+        bool update() {
+            if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+                return false;
+            }
+
+            read = middle.exchange(read, std::memory_order_acq_rel) & INDEX;
+
+            return true;
+        }
+
+        const T& front() const {
+            return slots[read];
+        }
+
+    private:
+        static constexpr uint8_t INDEX = 0x3;
+        static constexpr uint8_t FRESH = 0x4;
+
+        std::array<T, 3> slots{};
+
+        // Each index is kept on its own cache line, so the two threads only
+        // share the one they exchange through.
+        alignas(64) std::atomic<uint8_t> middle{1};
+        alignas(64) uint8_t write = 0;
+        alignas(64) uint8_t read = 2;
+};
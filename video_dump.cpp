@@ -0,0 +1,147 @@
+#include "video_dump.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+// Packs four bytes so they sit in memory in the order given.
+static uint32_t packBytes(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    const uint8_t bytes[4] = {a, b, c, d};
+    uint32_t packed;
+    std::memcpy(&packed, bytes, sizeof(packed));
+
+    return packed;
+}
+
+// BT.601 studio range, which is what Y4M readers assume.
+static uint32_t packYuv(const std::array<uint8_t, 3>& rgb) {
+    const double r = rgb[0];
+    const double g = rgb[1];
+    const double b = rgb[2];
+
+    const double y = 16 + (65.481 * r + 128.553 * g + 24.966 * b) / 255;
+    const double u = 128 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255;
+    const double v = 128 + (112.0 * r - 93.786 * g - 18.214 * b) / 255;
+
+    return packBytes(uint8_t(y + 0.5), uint8_t(u + 0.5), uint8_t(v + 0.5), 0);
+}
+
+VideoDump::VideoDump(const std::string& path, Format format, int width, int height, int scale)
+    : format(format), width(width * scale), height(height * scale) {
+    // The video gets its own copy of stdout, and stdout itself goes to
+    // stderr, so nothing else printed can end up in the stream.
+    if (path == "-") {
+        std::fflush(stdout);
+        const int fd = dup(STDOUT_FILENO);
+        out = fd >= 0 ? fdopen(fd, "wb") : nullptr;
+        if (out == nullptr) {
+            throw std::runtime_error("Unable to write video to stdout");
+        }
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    } else {
+        out = std::fopen(path.c_str(), "wb");
+        if (out == nullptr) {
+            throw std::runtime_error("Unable to create video file");
+        }
+    }
+
+    std::setvbuf(out, nullptr, _IOFBF, STREAM_BUFFER_SIZE);
+
+    for (size_t c = 0; c < palette.size(); ++c) {
+        const std::array<uint8_t, 3>& rgb = PALETTE_RGB[c];
+        palette[c] = format == Format::Y4M ? packYuv(rgb) : packBytes(rgb[0], rgb[1], rgb[2], 255);
+    }
+
+    if (format == Format::Y4M) {
+        std::fprintf(out, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", this->width, this->height);
+    }
+
+    // The display column each output column shows, for both resolutions.
+    for (int x = 0; x < this->width; ++x) {
+        loresColumns.push_back(uint16_t(x * displayWidth(false) / this->width));
+        hiresColumns.push_back(uint16_t(x * displayWidth(true) / this->width));
+    }
+
+    pixels.resize(size_t(displayWidth(true)) * displayHeight(true));
+    frame.resize(size_t(this->width) * this->height * (format == Format::Y4M ? 3 : 4));
+}
+
+VideoDump::~VideoDump() {
+    std::fclose(out);
+}
+
+void VideoDump::write(const DisplayPlanes& planes, bool hires) {
+    const int sourceWidth = displayWidth(hires);
+    const int sourceHeight = displayHeight(hires);
+    const std::vector<uint16_t>& columns = hires ? hiresColumns : loresColumns;
+
+    expandPixels(planes, sourceWidth, 0, sourceHeight - 1, palette, pixels.data(), sourceWidth * 4);
+
+    // Output rows that come from the same display row as the row above are
+    // copied from it rather than built again.
+    const size_t rowBytes = size_t(width) * (format == Format::RGBA ? 4 : 1);
+    const size_t planeSize = size_t(width) * height;
+    int previousSource = -1;
+
+    for (int y = 0; y < height; ++y) {
+        const int sourceY = y * sourceHeight / height;
+        const uint32_t* src = &pixels[size_t(sourceY) * sourceWidth];
+
+        if (format == Format::RGBA) {
+            uint8_t* row = &frame[y * rowBytes];
+
+            if (sourceY == previousSource) {
+                std::memcpy(row, row - rowBytes, rowBytes);
+            } else {
+                uint32_t* px = reinterpret_cast<uint32_t*>(row);
+                for (int x = 0; x < width; ++x) {
+                    px[x] = src[columns[x]];
+                }
+            }
+        } else {
+            uint8_t* row[3];
+            for (int p = 0; p < 3; ++p) {
+                row[p] = &frame[p * planeSize + y * rowBytes];
+            }
+
+            if (sourceY == previousSource) {
+                for (int p = 0; p < 3; ++p) {
+                    std::memcpy(row[p], row[p] - rowBytes, rowBytes);
+                }
+            } else {
+                for (int x = 0; x < width; ++x) {
+                    uint8_t yuv[4];
+                    std::memcpy(yuv, &src[columns[x]], sizeof(yuv));
+
+                    row[0][x] = yuv[0];
+                    row[1][x] = yuv[1];
+                    row[2][x] = yuv[2];
+                }
+            }
+        }
+
+        previousSource = sourceY;
+    }
+
+    if (format == Format::Y4M) {
+        std::fputs("FRAME\n", out);
+    }
+
+    if (std::fwrite(frame.data(), 1, frame.size(), out) != frame.size()) {
+        throw std::runtime_error("Unable to write video frame");
+    }
+}
+
+int VideoDump::getWidth() const {
+    return width;
+}
+
+int VideoDump::getHeight() const {
+    return height;
+}
+
+VideoDump::Format VideoDump::formatFor(const std::string& path) {
+    const bool y4m = path == "-" || (path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0);
+
+    return y4m ? Format::Y4M : Format::RGBA;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "display_buffer.h"
+
+// Writes display frames as an uncompressed 60 fps video stream, for
+// reference videos and anything else ffmpeg can take from a pipe.
+//
+// Y4M is 4:4:4 YUV with a header, so it can be read with no options; raw
+// RGBA is just the pixels, four bytes each, and needs the size and rate
+// given to the reader. The video has a fixed size, so frames at the other
+// resolution are scaled to fit: lores frames in a hires-sized video are
+// drawn at twice the scale, and hires frames in a lores-sized one at half.
+//
+// Each frame is built in memory and handed to a large stdio buffer in one
+// write, so the cost per pixel is a few stores and no syscalls.
+class VideoDump {
+
+    public:
+        enum class Format { Y4M, RGBA };
+
+        // "-" writes to stdout. Throws std::runtime_error if the file
+        // cannot be created.
+        VideoDump(const std::string& path, Format format, int width, int height, int scale);
+        ~VideoDump();
+
+        VideoDump(const VideoDump&) = delete;
+        VideoDump& operator=(const VideoDump&) = delete;
+
+        // Throws std::runtime_error if the write fails, e.g. once the
+        // reader at the other end of a pipe has gone.
+        void write(const DisplayPlanes& planes, bool hires);
+
+        int getWidth() const;
+        int getHeight() const;
+
+        // Y4M for .y4m files and stdout, RGBA otherwise.
+        static Format formatFor(const std::string& path);
+
+    private:
+        static constexpr size_t STREAM_BUFFER_SIZE = 1 << 20;
+
+        std::FILE* out = nullptr;
+        Format format;
+        int width;
+        int height;
+
+        // The palette, packed so each colour's bytes in memory are R, G, B,
+        // A (or Y, U, V and a spare for Y4M).
+        std::array<uint32_t, 4> palette;
+
+        std::vector<uint16_t> loresColumns;
+        std::vector<uint16_t> hiresColumns;
+        std::vector<uint32_t> pixels;
+        std::vector<uint8_t> frame;
+};
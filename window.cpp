@@ -1,6 +1,8 @@
 #include "window.h"
 #include "SDL.h"
+#include <bit>
 #include <iostream>
+#include <vector>
 
 Window::~Window() {
     if (pTexture != nullptr) { 
@@ -31,7 +33,7 @@ int Window::init() {
         SDL_WINDOW_SHOWN);
             
     if (pWindow == nullptr) {
-        std::printf("SDL_CreateWindow error: %s\n", SDL_GetError());
+        std::fprintf(stderr, "SDL_CreateWindow error: %s\n", SDL_GetError());
         
         return 1;
     }
@@ -41,7 +43,7 @@ int Window::init() {
         SDL_DestroyWindow(pWindow);
         pWindow = nullptr;
 
-        std::printf("SDL_CreateRenderer error: %s\n", SDL_GetError());
+        std::fprintf(stderr, "SDL_CreateRenderer error: %s\n", SDL_GetError());
         
         return 1;
     }
@@ -57,7 +59,7 @@ int Window::init() {
     );
 
     if (pTexture == nullptr) {
-        std::printf("SDL_CreateTexture error: %s\n", SDL_GetError());
+        std::fprintf(stderr, "SDL_CreateTexture error: %s\n", SDL_GetError());
         SDL_DestroyRenderer(pRenderer);
         pRenderer = nullptr;
 
@@ -68,8 +70,9 @@ int Window::init() {
     }
 
     SDL_PixelFormat* pixelFormat = SDL_AllocFormat(SDL_PIXELFORMAT_RGBA8888);
-    bgPacked = SDL_MapRGBA(pixelFormat, BG_COLOUR.r, BG_COLOUR.g, BG_COLOUR.b, BG_COLOUR.a);
-    fgPacked = SDL_MapRGBA(pixelFormat, FG_COLOUR.r, FG_COLOUR.g, FG_COLOUR.b, FG_COLOUR.a);
+    for (size_t c = 0; c < palette.size(); ++c) {
+        palette[c] = SDL_MapRGBA(pixelFormat, PALETTE_RGB[c][0], PALETTE_RGB[c][1], PALETTE_RGB[c][2], 255);
+    }
     SDL_FreeFormat(pixelFormat);
 
     SDL_SetRenderDrawColor(
@@ -85,47 +88,110 @@ int Window::init() {
     return 0;
 }
 
-void Window::draw(const std::array<std::array<uint8_t, 128>, 64>& buffer) {
-    void* pixels = nullptr;
-    int pitch = 0;
-    if (SDL_LockTexture(pTexture, nullptr, &pixels, &pitch) != 0) {
-        std::printf("SDL_LockTexture error: %s\n", SDL_GetError());
+void Window::draw(const DisplayPlanes& planes, uint64_t dirtyRows) {
+    dirtyRows = (dirtyRows | pendingRows) & displayRows(logicalHeight > 32);
+    if (dirtyRows == 0 && !presentPending) {
         return;
     }
+    pendingRows = 0;
+    presentPending = false;
 
-    Uint8* row = static_cast<Uint8*>(pixels);
-    for (int y = 0; y < logicalHeight; ++y) {
-        Uint32* px = reinterpret_cast<Uint32*>(row);
-
-        for (int x = 0; x < logicalWidth; ++x) {
-            const bool on = buffer[y][x] != 0;
-            px[x] = on ? fgPacked : bgPacked;
-        }
-
-        row += pitch;
+    if (dirtyRows != 0) {
+        upload(planes, dirtyRows);
     }
 
-    SDL_UnlockTexture(pTexture);
-
     SDL_RenderClear(pRenderer);
 
     SDL_Rect src{0, 0, logicalWidth, logicalHeight};
     SDL_RenderCopy(pRenderer, pTexture, &src, nullptr);
+    drawOverlay();
     SDL_RenderPresent(pRenderer);
 }
 
-void Window::terminalDraw(const std::array<std::array<uint8_t, 128>, 64>& displayBuffer) {
-    for (int y = 0; y < logicalHeight; ++y) {
-        for (int x = 0; x < logicalWidth; ++x) {
-            std::printf((displayBuffer)[y][x] ? "█" : " ");
-        }
-        std::printf("\n");
+void Window::upload(const DisplayPlanes& planes, uint64_t dirtyRows) {
+    // A locked region is a rectangle, so the rows between the first and last
+    // dirty ones go up with them.
+    const int firstRow = std::countr_zero(dirtyRows);
+    const int lastRow = 63 - std::countl_zero(dirtyRows);
+
+    SDL_Rect rows{0, firstRow, logicalWidth, lastRow - firstRow + 1};
+    void* pixels = nullptr;
+    int pitch = 0;
+    if (SDL_LockTexture(pTexture, &rows, &pixels, &pitch) != 0) {
+        std::fprintf(stderr, "SDL_LockTexture error: %s\n", SDL_GetError());
+        return;
     }
+
+    expandPixels(planes, logicalWidth, firstRow, lastRow, palette, pixels, pitch);
+
+    SDL_UnlockTexture(pTexture);
+}
+
+void Window::invalidate() {
+    pendingRows = ALL_ROWS;
 }
 
 void Window::setLogicalSize(const int width, const int height) {
     logicalWidth = width;
     logicalHeight = height;
+    pendingRows = ALL_ROWS;
+
+    SDL_RenderSetLogicalSize(pRenderer, logicalWidth, logicalHeight);
+}
+void Window::setOverlay(const std::string& text) {
+    if (text != overlay) {
+        overlay = text;
+        presentPending = true;
+    }
+}
+
+// 3x5 glyphs, one row of three bits per byte, for '0'-'9', '.' and 'x'.
+static const uint8_t OVERLAY_GLYPHS[12][5] = {
+    {7, 5, 5, 5, 7}, {2, 6, 2, 2, 7}, {7, 1, 7, 4, 7}, {7, 1, 7, 1, 7},
+    {5, 5, 7, 1, 1}, {7, 4, 7, 1, 7}, {7, 4, 7, 5, 7}, {7, 1, 1, 1, 1},
+    {7, 5, 7, 5, 7}, {7, 5, 7, 1, 7}, {0, 0, 0, 0, 2}, {0, 5, 2, 5, 0},
+};
+
+// Drawn in window pixels rather than display pixels, so it stays small
+// whatever the display resolution.
+void Window::drawOverlay() {
+    if (overlay.empty()) {
+        return;
+    }
+
+    SDL_RenderSetLogicalSize(pRenderer, 0, 0);
+
+    const int advance = 4 * OVERLAY_SCALE;
+    const int margin = OVERLAY_SCALE;
+
+    SDL_Rect box{0, 0, int(overlay.size()) * advance + margin, 5 * OVERLAY_SCALE + 2 * margin};
+    SDL_SetRenderDrawColor(pRenderer, FG_COLOUR.r, FG_COLOUR.g, FG_COLOUR.b, FG_COLOUR.a);
+    SDL_RenderFillRect(pRenderer, &box);
+
+    std::vector<SDL_Rect> pixels;
+    for (size_t i = 0; i < overlay.size(); ++i) {
+        const char c = overlay[i];
+        const int glyph = (c >= '0' && c <= '9') ? c - '0' : (c == '.') ? 10 : (c == 'x') ? 11 : -1;
+        if (glyph < 0) {
+            continue;
+        }
+
+        for (int y = 0; y < 5; ++y) {
+            for (int x = 0; x < 3; ++x) {
+                if ((OVERLAY_GLYPHS[glyph][y] >> (2 - x)) & 1) {
+                    pixels.push_back({margin + int(i) * advance + x * OVERLAY_SCALE, margin + y * OVERLAY_SCALE,
+                                      OVERLAY_SCALE, OVERLAY_SCALE});
+                }
+            }
+        }
+    }
+
+    SDL_SetRenderDrawColor(pRenderer, BG_COLOUR.r, BG_COLOUR.g, BG_COLOUR.b, BG_COLOUR.a);
+    SDL_RenderFillRects(pRenderer, pixels.data(), int(pixels.size()));
 
     SDL_RenderSetLogicalSize(pRenderer, logicalWidth, logicalHeight);
-}
\ No newline at end of file
+}
+
+void Window::setTitle(const std::string& title) {
+    SDL_SetWindowTitle(pWindow, title.c_str());
+}
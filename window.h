@@ -2,15 +2,25 @@
 
 #include <SDL.h>
 #include <array>
+#include <string>
+
+#include "display_buffer.h"
 
 class Window {
 
     public:
         ~Window();
         int init();
-        void draw(const std::array<std::array<uint8_t, 128>, 64>& displayBuffer);
-        void terminalDraw(const std::array<std::array<uint8_t, 128>, 64>& displayBuffer);
+        // Uploads the rows in dirtyRows, plus any the window itself needs
+        // redrawn, and presents. With nothing to upload it does nothing.
+        void draw(const DisplayPlanes& planes, uint64_t dirtyRows);
+        // Has the next draw upload the whole display, e.g. after an expose.
+        void invalidate();
         void setLogicalSize(const int width, const int height);
+        void setTitle(const std::string& title);
+        // Text drawn over the top left corner of the display on every
+        // present, in digits, '.' and 'x'. Empty hides it.
+        void setOverlay(const std::string& text);
 
     private:
 
@@ -24,10 +34,19 @@ class Window {
 
         int logicalWidth = 64;
         int logicalHeight = 32;
+
+        // Rows the next draw must upload whatever the display says.
+        uint64_t pendingRows = ALL_ROWS;
+        bool presentPending = false;
+
+        std::string overlay;
+        static constexpr int OVERLAY_SCALE = 4;
+        void upload(const DisplayPlanes& planes, uint64_t dirtyRows);
+        void drawOverlay();
         
-        static constexpr SDL_Color BG_COLOUR = { 200, 195, 190, 255 };
-        static constexpr SDL_Color FG_COLOUR = { 0, 0, 0, 255 };
+        static constexpr SDL_Color BG_COLOUR = { BACKGROUND_RGB[0], BACKGROUND_RGB[1], BACKGROUND_RGB[2], 255 };
+        static constexpr SDL_Color FG_COLOUR = { FOREGROUND_RGB[0], FOREGROUND_RGB[1], FOREGROUND_RGB[2], 255 };
 
-        Uint32 fgPacked = 0;
-        Uint32 bgPacked = 0;
+        // PALETTE_RGB in the texture's format.
+        std::array<Uint32, 4> palette{};
 };
\ No newline at end of file
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+// Marsaglia's xorshift32. The whole state is four bytes, so it is cheap to
+// keep per instance and to put in a savestate.
+constexpr uint32_t xorshift32(uint32_t x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+// xorshift32 never leaves zero, so a zero seed is swapped for a fixed one.
+constexpr uint32_t xorshiftSeed(uint32_t seed) {
+    return seed != 0 ? seed : 0x6D2B79F5u;
+}